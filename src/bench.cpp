@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "engine/engine.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double milliseconds(Clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// Peak resident memory of the process since it started in kilobytes, or 0 where it cannot be measured.
+// It never goes down, so it only means something for the run as a whole, peak_bytes is what each scene holds.
+long peak_rss_kb()
+{
+#if defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+#elif defined(__unix__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+// Brush and stamp spacing as the application starts out with
+const Brush default_brush { glm::vec3(1.0f, 0.0f, 0.0f), 10.0f, 1.0f, 1.0f, Settings().lifetime, 25 };
+const int stamp_spacing = 5;
+
+// Paint a stroke through a list of points the way the application does as the mouse moves through them
+void paint_stroke(WatercolourEngine& engine, BuiltinStamp& stamp, const std::vector<glm::vec2>& path, const Brush& brush)
+{
+    glm::vec2 last = path[0];
+    engine.place(as_stamp(stamp), last, brush);
+    engine.begin_stroke();
+    engine.wet_canvas(as_stamp(stamp), last, brush.size);
+
+    for (const glm::vec2& pos : path) {
+        const float dist = glm::distance(last, pos);
+        if (dist < stamp_spacing)
+            continue;
+        const glm::vec2 dir = glm::normalize(pos - last);
+        const int steps = (int)dist;
+        engine.paint_segment(stamp, last, dir, steps, stamp_spacing, brush);
+        last += (float)(steps / stamp_spacing * stamp_spacing) * dir;
+    }
+    engine.end_stroke();
+}
+
+// A wavy path from one side of a rectangle to the other, as points a mouse would report
+std::vector<glm::vec2> wave(const glm::vec2& from, const glm::vec2& to, float amplitude, float periods)
+{
+    std::vector<glm::vec2> path;
+    const glm::vec2 along = to - from, across = glm::normalize(glm::vec2(-along.y, along.x));
+    const int n = std::max((int)(glm::length(along) / 8.0f), 1);
+    for (int i = 0; i <= n; i++) {
+        const float t = (float)i / n;
+        path.push_back(from + t * along + amplitude * std::sin(6.2831853f * periods * t) * across);
+    }
+    return path;
+}
+
+// A scene painted before it is ticked, and optionally between ticks
+struct Scene {
+    const char* name;
+    glm::ivec2 size;
+    int ticks;
+    std::function<void(Settings&)> configure;
+    std::function<void(WatercolourEngine&, std::array<BuiltinStamp, 4>&)> paint;
+    std::function<void(WatercolourEngine&, std::array<BuiltinStamp, 4>&, int)> paint_during = nullptr; // Called before every tick
+};
+
+// One long stroke across the canvas with one of the built-in stamps
+Scene long_stroke(const char* name, int stamp_index)
+{
+    return { name, { 900, 600 }, 600, [](Settings&) {}, [stamp_index](WatercolourEngine& engine, std::array<BuiltinStamp, 4>& stamps) {
+                Brush brush = default_brush;
+                brush.size = 20.0f;
+                paint_stroke(engine, stamps[stamp_index], wave({ 50.0f, 300.0f }, { 850.0f, 300.0f }, 150.0f, 3.0f), brush);
+            } };
+}
+
+std::vector<Scene> canonical_scenes()
+{
+    std::vector<Scene> scenes = {
+        long_stroke("stroke-crunchy", 0),
+        long_stroke("stroke-wet-on-dry", 1),
+        long_stroke("stroke-wet-on-wet", 2),
+        long_stroke("stroke-blobby", 3),
+    };
+
+    // Many wet-on-wet strokes crossing the same small area, so splats overlap and keep rewetting each other
+    scenes.push_back({ "dense-wet-on-wet", { 900, 600 }, 600, [](Settings&) {}, [](WatercolourEngine& engine, std::array<BuiltinStamp, 4>& stamps) {
+                          for (int i = 0; i < 24; i++) {
+                              const float angle = 3.14159265f * i / 24;
+                              const glm::vec2 dir(std::cos(angle), std::sin(angle)), center(450.0f, 300.0f);
+                              Brush brush = default_brush;
+                              brush.color = glm::vec3((float)(i % 3 == 0), (float)(i % 3 == 1), (float)(i % 3 == 2));
+                              brush.size = 25.0f;
+                              paint_stroke(engine, stamps[2], wave(center - 150.0f * dir, center + 150.0f * dir, 20.0f, 1.0f), brush);
+                          }
+                      } });
+
+    // Strokes all over a canvas far larger than the default one
+    scenes.push_back({ "large-canvas", { 4000, 4000 }, 300, [](Settings&) {}, [](WatercolourEngine& engine, std::array<BuiltinStamp, 4>& stamps) {
+                          for (int i = 0; i < 16; i++) {
+                              const float y = 125.0f + 250.0f * i;
+                              Brush brush = default_brush;
+                              brush.size = 30.0f;
+                              paint_stroke(engine, stamps[i % 4], wave({ 100.0f, y }, { 3900.0f, y }, 80.0f, 6.0f), brush);
+                          }
+                      } });
+
+    // Splats which take ten times as long to dry, with water added every so often to rewet the fixed ones
+    scenes.push_back({ "long-drying", { 900, 600 }, 3000, [](Settings& settings) { settings.drying_time *= 10; }, [](WatercolourEngine& engine, std::array<BuiltinStamp, 4>& stamps) {
+                          for (int i = 0; i < 6; i++) {
+                              const float y = 75.0f + 90.0f * i;
+                              paint_stroke(engine, stamps[i % 4], wave({ 50.0f, y }, { 850.0f, y }, 30.0f, 2.0f), default_brush);
+                          }
+                      },
+        [](WatercolourEngine& engine, std::array<BuiltinStamp, 4>&, int tick) {
+            if (tick > 0 && tick % 200 == 0)
+                engine.add_water({ 50.0f, 50.0f + tick % 500 }, { 850.0f, 550.0f - tick % 500 }, 20.0f);
+        } });
+
+    return scenes;
+}
+
+struct Result {
+    const char* name;
+    glm::ivec2 size;
+    int ticks = 0;
+    size_t splats = 0, peak_vertices = 0, peak_bytes = 0;
+    uint64_t advected_vertices = 0, rejected_moves = 0;
+    double paint_ms = 0.0, resample_ms = 0.0, composite_ms = 0.0, tick_ms = 0.0;
+    std::array<double, tick_phase_count> phase_ms {};
+
+    double ticks_per_second() const { return tick_ms > 0.0 ? 1000.0 * ticks / tick_ms : 0.0; }
+    double ns_per_vertex() const { return advected_vertices > 0 ? 1e6 * phase_ms[Advect] / advected_vertices : 0.0; }
+};
+
+Result run(const Scene& scene, int threads, double tick_scale)
+{
+    Result result;
+    result.name = scene.name;
+    result.size = scene.size;
+    result.ticks = std::max((int)(scene.ticks * tick_scale), 1);
+
+    WatercolourEngine engine(scene.size);
+    engine.settings.threads = threads;
+    scene.configure(engine.settings);
+    std::array<BuiltinStamp, 4> stamps = { Crunchy {}, WetOnDry {}, WetOnWet {}, Blobby {} };
+
+    // Stamping and wetting the wet map
+    Clock::time_point start = Clock::now();
+    scene.paint(engine, stamps);
+    result.paint_ms = milliseconds(Clock::now() - start);
+    result.splats = engine.splats.live.size;
+
+    // Resampling every splat at once, as happens to the splats which become fixed
+    start = Clock::now();
+    engine.resample();
+    result.resample_ms = milliseconds(Clock::now() - start);
+
+    // The geometry the renderer composites, built every tick as if every tick were drawn
+    std::vector<glm::vec2> points;
+    const auto add = [&](const Splat&, ConstVertexSpan vertices) {
+        for (size_t i = 0; i < vertices.size(); i++)
+            points.push_back(vertices.pos(i));
+    };
+    const auto add_retired = [&](const glm::vec4&, std::span<const glm::vec2> outline) { points.insert(points.end(), outline.begin(), outline.end()); };
+
+    for (int t = 0; t < result.ticks; t++) {
+        if (scene.paint_during)
+            scene.paint_during(engine, stamps, t);
+
+        start = Clock::now();
+        engine.tick();
+        result.tick_ms += milliseconds(Clock::now() - start);
+        for (int p = 0; p < tick_phase_count; p++)
+            result.phase_ms[p] += 1000.0 * (double)(engine.phase_times[p].end - engine.phase_times[p].start);
+        result.advected_vertices += engine.counters.advected_vertices;
+        result.rejected_moves += engine.counters.rejected_moves;
+        result.peak_vertices = std::max(result.peak_vertices, engine.splats.vertex_count);
+        result.peak_bytes = std::max(result.peak_bytes, engine.counters.bytes);
+
+        start = Clock::now();
+        points.clear();
+        engine.take_retired(add_retired);
+        engine.splats.for_each(add);
+        result.composite_ms += milliseconds(Clock::now() - start);
+    }
+
+    return result;
+}
+
+// Phase names as JSON keys and CSV columns
+std::string key(TickPhase phase)
+{
+    std::string name = WatercolourEngine::name(phase);
+    for (char& c : name)
+        c = c == ' ' ? '_' : (char)std::tolower(c);
+    return name;
+}
+
+void print_json(const std::vector<Result>& results, int threads)
+{
+    std::printf("{\n  \"threads\": %d,\n  \"peak_rss_kb\": %ld,\n  \"scenes\": [", threads, peak_rss_kb());
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::printf("%s\n    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"ticks\": %d, \"splats\": %zu, \"peak_vertices\": %zu,", i > 0 ? "," : "", r.name, r.size.x, r.size.y, r.ticks, r.splats, r.peak_vertices);
+        std::printf(" \"paint_ms\": %.3f, \"resample_ms\": %.3f, \"composite_ms\": %.3f, \"tick_ms\": %.3f,", r.paint_ms, r.resample_ms, r.composite_ms, r.tick_ms);
+        std::printf(" \"phase_ms\": {");
+        for (int p = 0; p < tick_phase_count; p++)
+            std::printf("%s\"%s\": %.3f", p > 0 ? ", " : "", key((TickPhase)p).c_str(), r.phase_ms[p]);
+        std::printf("}, \"ticks_per_second\": %.2f, \"advected_vertices\": %llu, \"rejected_moves\": %llu, \"ns_per_vertex\": %.3f,", r.ticks_per_second(), (unsigned long long)r.advected_vertices, (unsigned long long)r.rejected_moves, r.ns_per_vertex());
+        std::printf(" \"peak_bytes\": %zu}", r.peak_bytes);
+    }
+    std::printf("\n  ]\n}\n");
+}
+
+void print_csv(const std::vector<Result>& results, int threads)
+{
+    std::printf("name,threads,width,height,ticks,splats,peak_vertices,paint_ms,resample_ms,composite_ms,tick_ms");
+    for (int p = 0; p < tick_phase_count; p++)
+        std::printf(",%s_ms", key((TickPhase)p).c_str());
+    std::printf(",ticks_per_second,advected_vertices,rejected_moves,ns_per_vertex,peak_bytes\n");
+
+    for (const Result& r : results) {
+        std::printf("%s,%d,%d,%d,%d,%zu,%zu,%.3f,%.3f,%.3f,%.3f", r.name, threads, r.size.x, r.size.y, r.ticks, r.splats, r.peak_vertices, r.paint_ms, r.resample_ms, r.composite_ms, r.tick_ms);
+        for (int p = 0; p < tick_phase_count; p++)
+            std::printf(",%.3f", r.phase_ms[p]);
+        std::printf(",%.2f,%llu,%llu,%.3f,%zu\n", r.ticks_per_second(), (unsigned long long)r.advected_vertices, (unsigned long long)r.rejected_moves, r.ns_per_vertex(), r.peak_bytes);
+    }
+
+    // Not a column, as it is the same for every scene
+    std::fprintf(stderr, "Peak RSS: %ld kB\n", peak_rss_kb());
+}
+
+void usage()
+{
+    std::fprintf(stderr,
+        "Usage: watercolour_bench [options]\n"
+        "  --csv              Print CSV instead of JSON\n"
+        "  --scene NAME       Only run scenes whose name contains NAME, may be repeated\n"
+        "  --threads N        Tick with N threads, 0 for all cores (default)\n"
+        "  --tick-scale X     Run X times as many ticks per scene\n"
+        "  --list             List the scenes and exit\n");
+}
+
+}
+
+// Benchmarks the engine on canonical scenes, without a window, and prints the results as JSON or CSV.
+// Every scene is painted and ticked the same way on every run, so results from different builds can be compared.
+int main(int argc, char** argv)
+{
+    bool csv = false, list = false;
+    int threads = 0;
+    double tick_scale = 1.0;
+    std::vector<std::string> filters;
+
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--csv"))
+            csv = true;
+        else if (!std::strcmp(argv[i], "--list"))
+            list = true;
+        else if (!std::strcmp(argv[i], "--scene") && has_value)
+            filters.push_back(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && has_value)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tick-scale") && has_value)
+            tick_scale = std::atof(argv[++i]);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    for (const Scene& scene : canonical_scenes()) {
+        bool selected = filters.empty();
+        for (const std::string& filter : filters)
+            selected |= std::string(scene.name).find(filter) != std::string::npos;
+        if (!selected)
+            continue;
+
+        if (list)
+            std::printf("%s\n", scene.name);
+        else {
+            std::fprintf(stderr, "%s...\n", scene.name);
+            results.push_back(run(scene, threads, tick_scale));
+        }
+    }
+
+    if (!list) {
+        const int n_threads = threads > 0 ? threads : WatercolourEngine::max_threads();
+        if (csv)
+            print_csv(results, n_threads);
+        else
+            print_json(results, n_threads);
+    }
+    return 0;
+}
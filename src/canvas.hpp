@@ -85,4 +85,4 @@ struct Canvas {
         glEnd();
         glDisable(GL_TEXTURE_2D);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,639 @@
+#include "engine.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Tasks with dependencies need OpenMP 4.5, older versions run the phases of a tick one after the other
+#if defined(_OPENMP) && _OPENMP >= 201511
+#define WATERCOLOUR_TASK_GRAPH
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int thread_index()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+// Run a phase of a tick, recording when it ran
+template <typename F>
+void timed(PhaseTime& time, Clock::time_point tick_start, F&& f)
+{
+    time.start = std::chrono::duration<float>(Clock::now() - tick_start).count();
+    f();
+    time.end = std::chrono::duration<float>(Clock::now() - tick_start).count();
+    time.average += 0.05f * (time.end - time.start - time.average);
+    time.thread = thread_index();
+}
+
+// Call f(k) for each active splat in a range of chunks, handing the chunks out to threads as they become free
+template <typename F>
+void for_chunks(const std::vector<uint32_t>& chunks, uint32_t c_begin, uint32_t c_end, [[maybe_unused]] int n_threads, F&& f)
+{
+#ifdef WATERCOLOUR_TASK_GRAPH
+#pragma omp taskloop grainsize(1)
+#elif defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+#endif
+    for (int c = (int)c_begin; c < (int)c_end; c++)
+        for (uint32_t k = chunks[c]; k < chunks[c + 1]; k++)
+            f(k);
+}
+
+}
+
+int WatercolourEngine::max_threads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+WatercolourEngine::WatercolourEngine(const glm::ivec2& size, WetMapFormat format)
+    : wet_map(size, format)
+    , grid(size)
+    , drying_time(settings.drying_time)
+{
+}
+
+void WatercolourEngine::reset(const glm::ivec2& size, WetMapFormat format)
+{
+    splats.clear();
+    wet_map = WetMap(size, format);
+    grid = SplatGrid(size);
+    phases.clear();
+    flowing = SlotSet();
+    sleeping = SlotSet();
+    fixed = SlotSet();
+    dried = SlotSet();
+    transitions = TimingWheel();
+    drying_time = settings.drying_time;
+    ticks = 0;
+    stroke_id = 0;
+    resample_counter = 0;
+
+    // Per slot state is resized at the start of each tick, which leaves the values of reused slots as they were
+    rewet_tick.clear();
+    moved.clear();
+    rewetted.clear();
+    sleepy.clear();
+    recounted.clear();
+    regrow.clear();
+    vertex_scale = 1.0f;
+    budget_vertex_count = 0;
+    retired.clear();
+    retired_points.clear();
+    counters = TickCounters();
+}
+
+void WatercolourEngine::begin_stroke()
+{
+    splats.clear_undone();
+}
+
+void WatercolourEngine::end_stroke()
+{
+    stroke_id++;
+}
+
+void WatercolourEngine::place(Stamp& stamp, const glm::vec2& pos, const Brush& brush)
+{
+    place(stamp, std::span<const glm::vec2>(&pos, 1), brush, [](size_t) {});
+}
+
+void WatercolourEngine::start_placed(size_t before)
+{
+    // The new splats are at the end of the live list
+    uint32_t slot = splats.live.tail;
+    for (size_t k = before; k < splats.live.size; k++, slot = splats.prev[slot]) {
+        bin(slot);
+        enter_phase(slot, ticks);
+    }
+}
+
+void WatercolourEngine::wet_canvas(Stamp& stamp, const glm::vec2& pos, float brush_size)
+{
+    water.clear();
+    if (stamp.varying_water()) {
+        stamp.wet_canvas(water, pos, brush_size);
+        for (const Water& w : water)
+            wet_map.add_water(w);
+        return;
+    }
+
+    // The footprint depends on where the stamp falls within its pixel as well as on the shape of its water
+    stamp.wet_canvas(water, glm::vec2(0.0f, 0.0f), brush_size);
+    const glm::vec2 pixel = glm::floor(pos);
+    wet_map.add_footprint(stamp.footprint(water, pos - pixel), glm::ivec2(pixel));
+}
+
+void WatercolourEngine::wet_canvas(Stamp& stamp, const glm::vec2& from, const glm::vec2& to, float brush_size)
+{
+    // The stamp's water moves with it
+    water.clear();
+    stamp.wet_canvas(water, from, brush_size);
+    for (const Water& w : water)
+        wet_map.sweep_water(w, w.pos + to - from);
+}
+
+void WatercolourEngine::add_water(const glm::vec2& pos, float radius)
+{
+    wet_map.add_water({ pos, radius });
+}
+
+void WatercolourEngine::add_water(const glm::vec2& from, const glm::vec2& to, float radius)
+{
+    wet_map.sweep_water({ from, radius }, to);
+}
+
+void WatercolourEngine::paint_segment(BuiltinStamp& stamp, const glm::vec2& start, const glm::vec2& dir, int steps, int spacing, const Brush& brush)
+{
+    stamp_points.clear();
+    for (int i = spacing; i <= steps; i += spacing)
+        stamp_points.push_back(start + (float)i * dir);
+
+    int wet_to = 0;
+    const auto wet = [&](int next) {
+        wet_canvas(as_stamp(stamp), start + (float)(wet_to + 1) * dir, start + (float)next * dir, brush.size);
+        wet_to = next;
+    };
+    place(stamp, stamp_points, brush, [&](size_t k) { wet((int)(k + 1) * spacing); });
+    if (wet_to < steps)
+        wet(steps);
+}
+
+void WatercolourEngine::bin(uint32_t slot)
+{
+    glm::vec2 min, max;
+    splats.view(slot).bounds(min, max);
+    grid.update(slot, grid.cells_of(min, max));
+}
+
+void WatercolourEngine::enter_phase(uint32_t slot, uint32_t tick)
+{
+    if (slot >= phases.size())
+        phases.resize(slot + 1, Phase::None);
+
+    const Splat& splat = splats.splats[slot];
+    if (splat.life(tick) >= 0) {
+        if (splats.cold[slot])
+            splats.thaw(slot);
+        phases[slot] = Phase::Flowing;
+        flowing.insert(slot);
+        transitions.schedule({ splat.fix_tick, slot, Expire });
+    } else if (splat.life(tick) >= -drying_time) {
+        if (settings.cold_storage && !splats.cold[slot])
+            splats.freeze(slot);
+        phases[slot] = Phase::Fixed;
+        fixed.insert(slot);
+        transitions.schedule({ splat.fix_tick + drying_time, slot, Dry });
+    } else {
+        phases[slot] = Phase::Dried;
+        dried.insert(slot);
+    }
+}
+
+void WatercolourEngine::leave_phase(uint32_t slot)
+{
+    switch (phases[slot]) {
+    case Phase::Flowing:
+        flowing.erase(slot);
+        break;
+    case Phase::Sleeping:
+        sleeping.erase(slot);
+        break;
+    case Phase::Fixed:
+        fixed.erase(slot);
+        break;
+    case Phase::Dried:
+        dried.erase(slot);
+        break;
+    case Phase::None:
+        break;
+    }
+    phases[slot] = Phase::None;
+}
+
+void WatercolourEngine::sleep(uint32_t slot)
+{
+    flowing.erase(slot);
+    sleeping.insert(slot);
+    phases[slot] = Phase::Sleeping;
+}
+
+void WatercolourEngine::wake(uint32_t slot)
+{
+    sleeping.erase(slot);
+    flowing.insert(slot);
+    phases[slot] = Phase::Flowing;
+    splats.splats[slot].stalled = 0;
+}
+
+void WatercolourEngine::transition(const TimingWheel::Event& event)
+{
+    // Rewetting a splat or changing the drying time leaves earlier transitions behind
+    Splat& splat = splats.splats[event.slot];
+    const bool due = event.kind == Expire
+        ? (phases[event.slot] == Phase::Flowing || phases[event.slot] == Phase::Sleeping) && splat.fix_tick == event.due
+        : phases[event.slot] == Phase::Fixed && splat.fix_tick + drying_time == event.due;
+    if (!due)
+        return;
+
+    // A splat which slept through its last tick still has its boundary resampled as it becomes fixed
+    if (phases[event.slot] == Phase::Sleeping && settings.resample_period > 0)
+        resample(event.slot, vertex_target(splat, splats.vertices_of(splat)), event.due);
+
+    leave_phase(event.slot);
+    enter_phase(event.slot, event.due + 1);
+}
+
+void WatercolourEngine::schedule(int n_threads)
+{
+    // Reschedule the drying of fixed splats if the drying time has changed
+    if (drying_time != settings.drying_time) {
+        drying_time = settings.drying_time;
+        active.assign(fixed.slots.begin(), fixed.slots.end());
+        for (uint32_t slot : active) {
+            leave_phase(slot);
+            enter_phase(slot, ticks);
+        }
+    }
+
+    rewet_tick.resize(splats.splats.size());
+    moved.resize(splats.splats.size());
+    rewetted.resize(splats.splats.size());
+    sleepy.resize(splats.splats.size());
+    recounted.resize(splats.splats.size());
+    regrow.resize(splats.splats.size());
+
+    // Every flowing splat is advected, but only fixed splats overlapping the tiles saturated during this tick can have been rewetted.
+    // Sleeping splats are binned with the area their vertices can reach, water added there wakes them up.
+    // Flowing splats come first, so that advecting and ageing can run as separate phases.
+    active.assign(flowing.slots.begin(), flowing.slots.end());
+    rewet_candidates.clear();
+    for (int t : wet_map.touched_tiles)
+        for (uint32_t slot : grid.cells[t])
+            if (phases[slot] == Phase::Fixed && rewet_tick[slot] != ticks + 1) {
+                rewet_tick[slot] = ticks + 1;
+                rewet_candidates.push_back(slot);
+            } else if (phases[slot] == Phase::Sleeping) {
+                wake(slot);
+                active.push_back(slot);
+            }
+    const uint32_t first_fixed = (uint32_t)active.size();
+    active.insert(active.end(), rewet_candidates.begin(), rewet_candidates.end());
+
+    // Split each kind into chunks of about the same number of vertices, several per thread so that fast threads can pick up more
+    size_t total = 0;
+    for (uint32_t slot : active)
+        total += splats.splats[slot].count;
+    const size_t target = std::max(total / (n_threads * chunks_per_thread), min_chunk_vertices);
+    chunks.clear();
+    chunks.push_back(0);
+    size_t vertices = 0;
+    for (uint32_t k = 0; k < active.size(); k++) {
+        if (k == first_fixed && chunks.back() != k) {
+            chunks.push_back(k);
+            vertices = 0;
+        }
+        vertices += splats.splats[active[k]].count;
+        if (vertices >= target) {
+            chunks.push_back(k + 1);
+            vertices = 0;
+        }
+    }
+    if (chunks.back() != active.size())
+        chunks.push_back((uint32_t)active.size());
+    fixed_chunk = (uint32_t)(std::find(chunks.begin(), chunks.end(), first_fixed) - chunks.begin());
+
+    if (scratch.size() < (size_t)n_threads)
+        scratch.resize(n_threads);
+    thread_counters.assign(std::max(thread_counters.size(), (size_t)n_threads), TickCounters());
+}
+
+void WatercolourEngine::tick()
+{
+    const Clock::time_point start = Clock::now();
+    const int n_threads = settings.threads > 0 ? settings.threads : max_threads();
+    const int resample_period = settings.resample_period * std::max(resample_stride, 1);
+    const bool resampling = resample_stride > 0 && resample_counter == resample_period;
+
+    timed(phase_times[Schedule], start, [&]() {
+        schedule(n_threads);
+
+        // Steer the vertex counts chosen by periodic resampling towards the budget, halfway in ratio each time.
+        // Fixed splats keep their counts, so the scale is only lowered further while the total is not already falling.
+        if (!settings.adaptive_vertices || settings.vertex_budget <= 0)
+            vertex_scale = 1.0f;
+        else if (resampling && splats.vertex_count > 0) {
+            const size_t budget = settings.vertex_budget;
+            if (splats.vertex_count < budget || splats.vertex_count >= budget_vertex_count)
+                vertex_scale = std::clamp(vertex_scale * std::sqrt((float)budget / splats.vertex_count), 0.01f, 1.0f);
+            budget_vertex_count = splats.vertex_count;
+        }
+    });
+
+    wet_map.visit([&](const auto& planes) {
+        // Advect flowing splats
+        const auto advect = [&]() {
+            timed(phase_times[Advect], start, [&]() {
+                for_chunks(chunks, 0, fixed_chunk, n_threads, [&](uint32_t k) {
+                    const uint32_t slot = active[k];
+                    Splat& splat = splats.splats[slot];
+                    const VertexSpan vertices = splats.vertices_of(splat);
+                    if ((splat.advect(vertices, wet_map, planes, settings.gravity, random, ticks, thread_counters[thread_index()]) || resampling) && settings.resample_period > 0) {
+                        // Resample boundary periodically or when a splat becomes fixed, after the tick if its vertices need more room
+                        const uint32_t n = vertex_target(splat, vertices), before = splat.count;
+                        if (SplatPool::padded_count(n) <= SplatPool::padded_count(before)) {
+                            splat.resample(vertices, scratch[thread_index()], random, ticks, n);
+                            recounted[slot] = n != before ? before : 0;
+                        } else
+                            regrow[slot] = n;
+                    }
+
+                    glm::vec2 min, max;
+                    splats.vertices_of(splat).bounds(min, max); // Resampling may have changed the number of vertices
+                    moved[slot] = grid.cells_of(min, max);
+
+                    // Put splats which cannot move to sleep, unless they are about to become fixed anyway
+                    if (settings.sleep_mode != SleepMode::Off && splat.life(ticks) > 0) {
+                        const float reach = splat.reach(settings.gravity);
+                        const bool dry = !wet_map.wet.any_pixels(glm::ivec2(glm::floor(min - reach)), glm::ivec2(glm::ceil(max + reach)));
+                        sleepy[slot] = dry || (settings.sleep_mode == SleepMode::Stalled && (int)splat.stalled >= settings.sleep_ticks);
+                        if (sleepy[slot])
+                            moved[slot] = grid.cells_of(min - reach, max + reach);
+                    }
+                });
+            });
+        };
+
+        // Age fixed splats, frozen ones are only checked here and thawed to be rewetted while bookkeeping
+        const auto age = [&]() {
+            timed(phase_times[Age], start, [&]() {
+                for_chunks(chunks, fixed_chunk, (uint32_t)chunks.size() - 1, n_threads, [&](uint32_t k) {
+                    const uint32_t slot = active[k];
+                    Splat& splat = splats.splats[slot];
+                    rewetted[slot] = splats.cold[slot]
+                        ? splats.cold_test(slot, wet_map.saturated)
+                        : splat.age(splats.vertices_of(splat), wet_map, settings.lifetime, settings.unfixing_strength, random, ticks);
+                });
+            });
+        };
+
+        // Drying tiles only touches the wet map's planes and wet pixels, which nothing but advection reads,
+        // and desaturating has to wait until the saturated pixels have been read by ageing and rewetting
+        const auto dry_tiles = [&]() { timed(phase_times[DryTiles], start, [&]() { wet_map.dry_tiles(); }); };
+        const auto bookkeep = [&]() { timed(phase_times[Bookkeep], start, [&]() { this->bookkeep(); }); };
+        const auto desaturate = [&]() { timed(phase_times[Desaturate], start, [&]() { wet_map.desaturate(); }); };
+
+#ifdef WATERCOLOUR_TASK_GRAPH
+        // Only the addresses of these matter, as the dependencies between tasks
+        char advected, aged, tiles_dried, bookkept;
+#pragma omp parallel num_threads(n_threads)
+#pragma omp single
+        {
+#pragma omp task depend(out : advected)
+            advect();
+#pragma omp task depend(out : aged)
+            age();
+#pragma omp task depend(in : advected) depend(out : tiles_dried)
+            dry_tiles();
+#pragma omp task depend(in : advected, aged) depend(out : bookkept)
+            bookkeep();
+#pragma omp task depend(in : tiles_dried, bookkept)
+            desaturate();
+        }
+#else
+        advect();
+        age();
+        dry_tiles();
+        bookkeep();
+        desaturate();
+#endif
+    });
+
+    if (resample_period > 0)
+        resample_counter = resample_counter % resample_period + 1;
+    ticks++;
+
+    profile(start);
+}
+
+void WatercolourEngine::profile(std::chrono::steady_clock::time_point start)
+{
+    counters.advected_vertices = 0;
+    counters.rejected_moves = 0;
+    for (const TickCounters& thread : thread_counters)
+        counters += thread;
+    const size_t bytes = splats.bytes();
+    counters.pool_resizes += bytes != pool_bytes;
+    pool_bytes = bytes;
+    counters.bytes = bytes + (size_t)wet_map.bytes_per_pixel() * wet_map.size.x * wet_map.size.y;
+
+    for (int p = 0; p < tick_phase_count; p++)
+        phase_history[p].add(1000.0f * (phase_times[p].end - phase_times[p].start));
+    advected_history.add((float)counters.advected_vertices);
+    rejected_history.add((float)counters.rejected_moves);
+
+    if (trace.recording) {
+        const double t = Trace::time(start);
+        for (int p = 0; p < tick_phase_count; p++)
+            trace.span(name((TickPhase)p), 1 + phase_times[p].thread, t + 1e6 * (double)phase_times[p].start, t + 1e6 * (double)phase_times[p].end);
+        trace.counter("Advected vertices", t, (double)counters.advected_vertices);
+        trace.counter("Rejected moves", t, (double)counters.rejected_moves);
+        trace.counter("Bytes", t, (double)counters.bytes);
+    }
+}
+
+void WatercolourEngine::bookkeep()
+{
+    // None of this is safe to do from several threads
+    for (uint32_t slot : active) {
+        if (recounted[slot]) {
+            splats.recounted(slot, recounted[slot]);
+            recounted[slot] = 0;
+        }
+        if (regrow[slot]) {
+            resample(slot, regrow[slot], ticks);
+            regrow[slot] = 0;
+
+            // Resampled vertices lie on the old boundary, so a splat going to sleep stays within the reach it is binned with
+            if (!sleepy[slot]) {
+                glm::vec2 min, max;
+                splats.vertices_of(splats.splats[slot]).bounds(min, max);
+                moved[slot] = grid.cells_of(min, max);
+            }
+        }
+        if (!moved[slot].empty()) {
+            grid.update(slot, moved[slot]);
+            moved[slot] = SplatGrid::Range();
+        }
+        if (sleepy[slot]) {
+            sleep(slot);
+            sleepy[slot] = false;
+        }
+        if (rewetted[slot] && splats.cold[slot]) {
+            splats.thaw(slot);
+            Splat& splat = splats.splats[slot];
+            rewetted[slot] = splat.age(splats.vertices_of(splat), wet_map, settings.lifetime, settings.unfixing_strength, random, ticks);
+        }
+        if (rewetted[slot]) {
+            leave_phase(slot);
+            enter_phase(slot, ticks + 1);
+            rewetted[slot] = false;
+        }
+    }
+
+    // Fix and dry the splats whose time has come
+    transitions.advance([&](const TimingWheel::Event& event) { transition(event); });
+    retire_dried();
+}
+
+void WatercolourEngine::retire_dried()
+{
+    // Ids are given out in painting order
+    std::sort(dried.slots.begin(), dried.slots.end(), [&](uint32_t a, uint32_t b) { return splats.splats[a].id < splats.splats[b].id; });
+    for (uint32_t slot : dried.slots) {
+        const ConstVertexSpan vertices = splats.view(slot);
+        retired.push_back({ splats.splats[slot].color, (uint32_t)retired_points.size(), vertices.count });
+        for (size_t i = 0; i < vertices.size(); i++)
+            retired_points.push_back(vertices.pos(i));
+        grid.remove(slot);
+        phases[slot] = Phase::None;
+        splats.retire(slot);
+    }
+    dried.clear();
+}
+
+uint64_t WatercolourEngine::fingerprint() const
+{
+    // FNV-1a over the bits of everything hashed
+    uint64_t hash = 14695981039346656037ull;
+    const auto add = [&](uint32_t value) {
+        for (int i = 0; i < 4; i++, value >>= 8)
+            hash = (hash ^ (value & 0xff)) * 1099511628211ull;
+    };
+    add(ticks);
+    add((uint32_t)splats.live.size);
+    add((uint32_t)splats.undone.size);
+    splats.for_each([&](const Splat& splat, ConstVertexSpan vertices) {
+        add(splat.id);
+        add(splat.fix_tick);
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const glm::vec2 p = vertices.pos(i);
+            add(std::bit_cast<uint32_t>(p.x));
+            add(std::bit_cast<uint32_t>(p.y));
+        }
+    });
+    return hash;
+}
+
+uint8_t WatercolourEngine::critical_path() const
+{
+    // Phases are numbered in an order their dependencies allow, so each one's longest chain is known by the time it is reached
+    std::array<float, tick_phase_count> finish;
+    std::array<int, tick_phase_count> previous;
+    for (int p = 0; p < tick_phase_count; p++) {
+        float ready = 0.0f;
+        previous[p] = -1;
+        for (int d = 0; d < p; d++)
+            if (phase_dependencies[p] >> d & 1 && finish[d] >= ready) {
+                ready = finish[d];
+                previous[p] = d;
+            }
+        finish[p] = ready + phase_times[p].average;
+    }
+
+    uint8_t path = 0;
+    for (int p = tick_phase_count - 1; p >= 0; p = previous[p])
+        path |= 1 << p;
+    return path;
+}
+
+const char* WatercolourEngine::name(TickPhase phase)
+{
+    switch (phase) {
+    case Schedule:
+        return "Schedule";
+    case Advect:
+        return "Advect";
+    case Age:
+        return "Age";
+    case DryTiles:
+        return "Dry tiles";
+    case Bookkeep:
+        return "Bookkeep";
+    case Desaturate:
+        return "Desaturate";
+    }
+    return "";
+}
+
+void WatercolourEngine::resample()
+{
+    // Frozen splats no longer move, their boundaries are left as they are
+    for (uint32_t slot = splats.live.head; slot != SplatPool::none; slot = splats.next[slot])
+        if (!splats.cold[slot])
+            resample(slot, vertex_target(splats.splats[slot], splats.vertices_of(splats.splats[slot])), ticks);
+}
+
+uint32_t WatercolourEngine::vertex_target(const Splat& splat, ConstVertexSpan vertices) const
+{
+    if (!settings.adaptive_vertices)
+        return splat.count;
+
+    // Keep the count unless it changes by more than an eighth, so that splats do not flicker between counts
+    const uint32_t n = splat.adaptive_count(vertices, settings.vertex_spacing, vertex_scale, settings.min_vertices, settings.max_vertices);
+    return n * 8 < splat.count * 7 || n * 8 > splat.count * 9 ? n : splat.count;
+}
+
+void WatercolourEngine::resample(uint32_t slot, uint32_t n, uint32_t tick)
+{
+    scratch.resize(std::max(scratch.size(), (size_t)1));
+    const uint32_t before = splats.splats[slot].count;
+    splats.make_room(slot, n);
+    Splat& splat = splats.splats[slot];
+    splat.resample(splats.vertices_of(splat), scratch[0], random, tick, n);
+    splats.recounted(slot, before);
+}
+
+void WatercolourEngine::undo()
+{
+    const size_t before = splats.undone.size;
+    splats.undo();
+
+    // Undone splats are off the canvas and stop ageing, so their lifetime is kept relative to now
+    uint32_t slot = splats.undone.tail;
+    for (size_t k = before; k < splats.undone.size; k++, slot = splats.prev[slot]) {
+        grid.remove(slot);
+        leave_phase(slot);
+        splats.splats[slot].fix_tick -= ticks;
+    }
+}
+
+void WatercolourEngine::redo()
+{
+    const size_t before = splats.live.size;
+    splats.redo();
+
+    uint32_t slot = splats.live.tail;
+    for (size_t k = before; k < splats.live.size; k++, slot = splats.prev[slot]) {
+        splats.splats[slot].fix_tick += ticks;
+        bin(slot);
+        enter_phase(slot, ticks);
+    }
+}
@@ -0,0 +1,270 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <glm/glm.hpp>
+#include <span>
+#include <variant>
+#include <vector>
+
+#include "profiler.hpp"
+#include "slot_set.hpp"
+#include "splat.hpp"
+#include "splat_grid.hpp"
+#include "splat_pool.hpp"
+#include "stamp.hpp"
+#include "timing_wheel.hpp"
+#include "wet_map.hpp"
+
+// Parameters of the brush used to place stamps
+struct Brush {
+    glm::vec3 color;
+    float size, roughness, flow;
+    int lifetime, vertices;
+};
+
+// When flowing splats which cannot move are put to sleep until water is added near them
+enum class SleepMode {
+    Off,
+    Dry, // No vertex can reach a wet pixel
+    Stalled // As Dry, or no vertex has moved for a number of ticks
+};
+
+// Global simulation parameters
+struct Settings {
+    float gravity = 0.0f;
+    float unfixing_strength = 1.0f;
+    int drying_time = 600;
+    int resample_period = 10;
+    int lifetime = 60; // Lifetime given to rewetted splats
+    int threads = 0; // Number of threads used to tick, 0 for all cores
+    SleepMode sleep_mode = SleepMode::Dry;
+    int sleep_ticks = 30; // Ticks without movement before a splat is put to sleep in SleepMode::Stalled
+    bool adaptive_vertices = false; // Resample splats into a number of vertices chosen from their perimeter and curvature
+    int min_vertices = 8, max_vertices = 64;
+    float vertex_spacing = 10.0f; // Distance between adaptive vertices along a smooth boundary
+    int vertex_budget = 0; // Total vertices adaptive resampling aims to keep all splats within, 0 for no limit
+    bool cold_storage = true; // Freeze the vertices of fixed splats into quantised positions until they are rewetted
+
+    bool operator==(const Settings&) const = default;
+};
+
+// Where a live splat is in its lifetime
+enum class Phase : uint8_t {
+    None, // Not live
+    Flowing,
+    Sleeping, // Flowing, but not advected until water is added near it
+    Fixed,
+    Dried // Waiting to be retired
+};
+
+// Transitions between phases, scheduled in the timing wheel
+enum Transition : uint8_t {
+    Expire, // Flowing to fixed
+    Dry // Fixed to dried
+};
+
+// Phases of a tick, in an order their dependencies allow: advecting and ageing follow scheduling,
+// drying the wet map's tiles only waits for advection, and bookkeeping for both advection and ageing
+enum TickPhase : uint8_t {
+    Schedule,
+    Advect,
+    Age,
+    DryTiles,
+    Bookkeep, // Rebinning, putting to sleep, rewetting and transitions between phases
+    Desaturate
+};
+
+constexpr int tick_phase_count = 6;
+
+// Phases each phase waits for, as bit masks
+constexpr std::array<uint8_t, tick_phase_count> phase_dependencies = { 0, 1 << Schedule, 1 << Schedule, 1 << Advect, 1 << Advect | 1 << Age, 1 << DryTiles | 1 << Bookkeep };
+
+// When a phase ran during the last tick, in seconds from the start of the tick
+struct PhaseTime {
+    float start = 0.0f, end = 0.0f;
+    float average = 0.0f; // Duration averaged over recent ticks
+    uint32_t thread = 0; // Worker the phase was started on
+};
+
+// The outline of a splat as the renderer draws it
+struct SplatShape {
+    glm::vec4 color;
+    uint32_t first, count; // Range of its vertices in the points it is kept with
+};
+
+// The watercolour simulation: owns the splats and the wet map and advances them tick by tick.
+// It has no dependency on OpenGL, drawing the splats and the wet map is left to the caller.
+struct WatercolourEngine {
+
+    Settings settings;
+    WetMap wet_map;
+    SplatPool splats;
+    SplatGrid grid; // Bins every live splat
+    std::vector<Phase> phases; // Indexed by slot
+    SlotSet flowing, sleeping, fixed, dried;
+    TimingWheel transitions;
+    int drying_time; // The drying time the transitions of fixed splats were scheduled with
+    Random random;
+    uint32_t ticks = 0; // Ticks since the canvas was created, part of the counter of every random sample
+    int stroke_id = 0;
+    int resample_counter = 0;
+    int resample_stride = 1; // Periodic resampling only happens every this many resample periods, or never if 0, for shedding load
+    std::vector<Water> water; // Scratch space for the water added by stamps
+    std::vector<glm::vec2> stamp_points; // Scratch space for the points along a stroke segment to place stamps at
+    std::vector<ResampleScratch> scratch; // Scratch space for resampling, one per thread
+    std::vector<uint32_t> active; // Slots of the splats updated this tick, flowing ones first
+    std::vector<uint32_t> chunks; // Boundaries of the chunks of active splats handed out to threads
+    uint32_t fixed_chunk = 0; // The first chunk of fixed splats, those before it are flowing
+    std::vector<uint32_t> rewet_candidates; // Scratch space for the fixed splats which may have been rewetted this tick
+    std::vector<uint32_t> rewet_tick; // Per slot, ticks + 1 if the splat overlaps a tile saturated during this tick
+    std::vector<SplatGrid::Range> moved; // Per slot, the cells of a splat advected this tick, rebinned after the tick
+    std::vector<uint8_t> rewetted; // Per slot, set if a fixed splat was rewetted this tick
+    std::vector<uint8_t> sleepy; // Per slot, set if a flowing splat should be put to sleep after this tick
+    std::vector<uint32_t> recounted; // Per slot, the vertex count a splat had before being resampled into another this tick, 0 if unchanged
+    std::vector<uint32_t> regrow; // Per slot, the vertex count to resample a splat into after the tick once given more room, 0 if none
+    float vertex_scale = 1.0f; // Scale of adaptive vertex counts keeping the total within the budget
+    size_t budget_vertex_count = 0; // Total vertices when vertex_scale was last updated
+    std::vector<SplatShape> retired; // Splats which dried and left the pool since they were last taken, in the order they are to be drawn
+    std::vector<glm::vec2> retired_points;
+
+    std::array<PhaseTime, tick_phase_count> phase_times;
+    std::array<History, tick_phase_count> phase_history; // Milliseconds each phase took in recent ticks
+    TickCounters counters; // Of the last tick
+    std::vector<TickCounters> thread_counters; // Counted by each thread during a tick
+    History advected_history, rejected_history; // Vertices advected and moves rejected in recent ticks
+    size_t pool_bytes = 0; // Memory held by the splat pool after the last tick
+    Trace trace; // The phases and counters of every tick while recording
+
+    static constexpr size_t chunks_per_thread = 8;
+    static constexpr size_t min_chunk_vertices = 1024;
+
+    WatercolourEngine(const glm::ivec2& size, WetMapFormat format = WetMapFormat::Float);
+
+    // Discard all splats and start over with a blank canvas of the given size
+    void reset(const glm::ivec2& size, WetMapFormat format = WetMapFormat::Float);
+
+    // Start a new stroke, discarding the redo history
+    void begin_stroke();
+
+    // Finish the current stroke
+    void end_stroke();
+
+    // Place a stamp as part of the current stroke
+    void place(Stamp& stamp, const glm::vec2& pos, const Brush& brush);
+
+    // Place a stamp at each of several points of the current stroke in one batch, calling placing(k) just before the k-th.
+    // The splats are binned and start flowing once all are placed, given a concrete stamp type its calls are resolved statically.
+    template <typename S, typename F>
+    void place(S& stamp, std::span<const glm::vec2> points, const Brush& brush, F&& placing)
+    {
+        const size_t before = splats.live.size;
+        const size_t n_splats = points.size() * stamp.splat_count();
+        splats.reserve(n_splats, n_splats * SplatPool::padded_count(brush.vertices));
+
+        for (size_t k = 0; k < points.size(); k++) {
+            placing(k);
+            if (wet_map.contains_point(points[k]))
+                stamp.place(splats, wet_map, random, points[k], brush.color, brush.size, brush.roughness, brush.flow, stroke_id, ticks + brush.lifetime, brush.vertices);
+        }
+        start_placed(before);
+    }
+
+    template <typename F>
+    void place(BuiltinStamp& stamp, std::span<const glm::vec2> points, const Brush& brush, F&& placing)
+    {
+        std::visit([&](auto& s) { place(s, points, brush, placing); }, stamp);
+    }
+
+    // Bin the splats placed since the live list held a number of splats and start them flowing
+    void start_placed(size_t before);
+
+    // Add water to the wet map in the shape of a stamp
+    void wet_canvas(Stamp& stamp, const glm::vec2& pos, float brush_size);
+
+    // Add water to the wet map in the shape of a stamp swept along a straight line
+    void wet_canvas(Stamp& stamp, const glm::vec2& from, const glm::vec2& to, float brush_size);
+
+    // Add a disc of water to the wet map
+    void add_water(const glm::vec2& pos, float radius);
+
+    // Add water to the wet map in the shape of a disc swept along a straight line
+    void add_water(const glm::vec2& from, const glm::vec2& to, float radius);
+
+    // Paint a segment of the current stroke from start along a unit direction for a number of pixels, placing a stamp every spacing pixels
+    // and wetting the canvas up to each stamp in one pass just before placing it, as placing a stamp can change the shape of its water
+    void paint_segment(BuiltinStamp& stamp, const glm::vec2& start, const glm::vec2& dir, int steps, int spacing, const Brush& brush);
+
+    // Advance the simulation by one tick, running its phases as a graph of tasks so that independent ones overlap
+    void tick();
+
+    // Collect the splats to update in the next tick and divide them into chunks
+    void schedule(int n_threads);
+
+    // Rebin the splats updated this tick, put them to sleep or start rewetted splats flowing again, then run the transitions due
+    // and retire the splats which have dried
+    void bookkeep();
+
+    // Total the counters of a tick which started at a point in time, and add its phases and counters to the histories and the trace
+    void profile(std::chrono::steady_clock::time_point start);
+
+    // Return the phases on the longest chain of dependent phases, by their averaged durations, as a bit mask
+    uint8_t critical_path() const;
+
+    static const char* name(TickPhase phase);
+
+    // Put a live splat in the phase matching its lifetime at the start of a tick, and schedule its next transition
+    void enter_phase(uint32_t slot, uint32_t tick);
+
+    // Take a splat out of its phase
+    void leave_phase(uint32_t slot);
+
+    // Move a splat between the flowing and sleeping phases
+    void sleep(uint32_t slot);
+    void wake(uint32_t slot);
+
+    // Handle a transition due this tick, unless it has become stale
+    void transition(const TimingWheel::Event& event);
+
+    // Number of threads used to tick when settings.threads is 0
+    static int max_threads();
+
+    // Bin a splat in the grid by its current bounding box
+    void bin(uint32_t slot);
+
+    // Force the splat boundary resampling step
+    void resample();
+
+    // Number of vertices to resample a splat into
+    uint32_t vertex_target(const Splat& splat, ConstVertexSpan vertices) const;
+
+    // Resample a splat into a number of vertices, moving its vertices if they need more room, which is not safe to do from several threads
+    void resample(uint32_t slot, uint32_t n, uint32_t tick);
+
+    // Undo or redo the last stroke whose splats have not dried yet
+    void undo();
+    void redo();
+
+    // Remove the splats which have dried from the pool, keeping their outlines in painting order until they are taken.
+    // This happens at the end of every tick, so that when splats leave the pool does not depend on when they are drawn.
+    // Splats dry as soon as they are due, they do not wait for older splats which are still wet.
+    void retire_dried();
+
+    // Pass each splat retired since the last call to draw(color, points), in the order they are to be drawn onto the canvas
+    template <typename F>
+    void take_retired(F&& draw)
+    {
+        for (const SplatShape& shape : retired)
+            draw(shape.color, std::span<const glm::vec2>(retired_points.data() + shape.first, shape.count));
+        retired.clear();
+        retired_points.clear();
+    }
+
+    // Return true iff there are retired splats waiting to be taken
+    bool has_retired() const
+    {
+        return !retired.empty();
+    }
+
+    // Hash of the tick, the live splats and the number of undone ones, for checking that a replay follows the session it was recorded from
+    uint64_t fingerprint() const;
+};
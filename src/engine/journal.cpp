@@ -0,0 +1,296 @@
+#include "journal.hpp"
+
+#include <chrono>
+#include <fstream>
+
+namespace {
+
+constexpr int max_canvas_size = 4000; // Largest width or height of a canvas, as allowed by the new canvas dialog
+
+template <class... F>
+struct Overloaded : F... {
+    using F::operator()...;
+};
+
+// Write a scalar or a glm vector, neither of which has padding. Bools are written as a byte holding 0 or 1.
+template <typename T>
+void put(std::vector<unsigned char>& bytes, const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T> && !std::is_empty_v<T>);
+    if constexpr (std::is_same_v<T, bool>)
+        bytes.push_back(value ? 1 : 0);
+    else {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+}
+
+// LEB128, most ticks fit in two or three bytes
+void put_varint(std::vector<unsigned char>& bytes, uint32_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        bytes.push_back((unsigned char)(value | 0x80));
+    bytes.push_back((unsigned char)value);
+}
+
+// Call f with each field of a brush in the order they are written, until it returns false
+template <typename B, typename F>
+bool brush_fields(B& brush, F&& f)
+{
+    return f(brush.color) && f(brush.size) && f(brush.roughness) && f(brush.flow) && f(brush.lifetime) && f(brush.vertices);
+}
+
+// Call f with each field of an action in the order they are written, until it returns false.
+// Structs are written field by field, so that their padding never ends up in a journal.
+template <typename A, typename F>
+bool fields(A& a, F&& f)
+{
+    using T = std::remove_const_t<A>;
+    if constexpr (std::is_same_v<T, action::Reset>)
+        return f(a.size) && f(a.format) && f(a.background) && f(a.seed);
+    else if constexpr (std::is_same_v<T, action::SetSettings>) {
+        auto& s = a.settings;
+        return f(s.gravity) && f(s.unfixing_strength) && f(s.drying_time) && f(s.resample_period) && f(s.lifetime) && f(s.threads) && f(s.sleep_mode)
+            && f(s.sleep_ticks) && f(s.adaptive_vertices) && f(s.min_vertices) && f(s.max_vertices) && f(s.vertex_spacing) && f(s.vertex_budget) && f(s.cold_storage);
+    } else if constexpr (std::is_same_v<T, action::BeginStroke>)
+        return f(a.stamp) && f(a.pos) && brush_fields(a.brush, f);
+    else if constexpr (std::is_same_v<T, action::PaintSegment>)
+        return f(a.stamp) && f(a.start) && f(a.dir) && f(a.steps) && f(a.spacing) && brush_fields(a.brush, f);
+    else if constexpr (std::is_same_v<T, action::AddWater>)
+        return f(a.pos) && f(a.radius);
+    else if constexpr (std::is_same_v<T, action::SweepWater>)
+        return f(a.from) && f(a.to) && f(a.radius);
+    else if constexpr (std::is_same_v<T, action::SetResampleStride>)
+        return f(a.stride);
+    else if constexpr (std::is_same_v<T, action::Mark>)
+        return f(a.fingerprint);
+    else {
+        static_assert(std::is_empty_v<T>, "Actions with fields have to list them");
+        return true;
+    }
+}
+
+// Stamps have a vtable, so only their parameters are written
+void put_stamp(std::vector<unsigned char>& bytes, const BuiltinStamp& stamp)
+{
+    put(bytes, (uint8_t)stamp.index());
+    std::visit(Overloaded {
+                   [&](const Crunchy& s) { put(bytes, s.scale); },
+                   [&](const WetOnDry& s) {
+                       put(bytes, s.lobes);
+                       put(bytes, s.b);
+                   },
+                   [&](const WetOnWet& s) { put(bytes, s.scale); },
+                   [&](const Blobby& s) {
+                       put(bytes, s.offset);
+                       put(bytes, s.sizes);
+                   } },
+        stamp);
+}
+
+bool get_stamp(Journal::Reader& reader, BuiltinStamp& stamp)
+{
+    uint8_t index;
+    if (!reader.get(index))
+        return false;
+    switch (index) {
+    case 0: {
+        Crunchy s;
+        const bool ok = reader.get(s.scale);
+        stamp = std::move(s);
+        return ok;
+    }
+    case 1: {
+        WetOnDry s;
+        const bool ok = reader.get(s.lobes) && s.lobes >= 2 && s.lobes <= 12 && reader.get(s.b);
+        stamp = std::move(s);
+        return ok;
+    }
+    case 2: {
+        WetOnWet s;
+        const bool ok = reader.get(s.scale);
+        stamp = std::move(s);
+        return ok;
+    }
+    case 3: {
+        Blobby s;
+        const bool ok = reader.get(s.offset) && reader.get(s.sizes);
+        stamp = std::move(s);
+        return ok;
+    }
+    }
+    return false;
+}
+
+bool valid(const Brush& brush)
+{
+    return brush.vertices >= 3;
+}
+
+// Return false for actions no session could have recorded, which replaying could index out of bounds with or divide by zero
+bool valid(const Action& action)
+{
+    return std::visit(Overloaded {
+                          [](const action::Reset& a) {
+                              return a.size.x >= 1 && a.size.y >= 1 && a.size.x <= max_canvas_size && a.size.y <= max_canvas_size
+                                  && (int)a.format >= (int)WetMapFormat::Float && (int)a.format <= (int)WetMapFormat::Compact16;
+                          },
+                          [](const action::SetSettings& a) {
+                              const Settings& s = a.settings;
+                              return (int)s.sleep_mode >= (int)SleepMode::Off && (int)s.sleep_mode <= (int)SleepMode::Stalled && s.threads >= 0
+                                  && s.min_vertices >= 3 && s.max_vertices >= s.min_vertices && s.vertex_spacing > 0.0f;
+                          },
+                          [](const action::SetStamp& a) { return a.index < 4; },
+                          [](const action::BeginStroke& a) { return a.stamp < 4 && valid(a.brush); },
+                          [](const action::PaintSegment& a) { return a.stamp < 4 && a.steps >= 0 && a.spacing >= 1 && valid(a.brush); },
+                          [](const action::SetResampleStride& a) { return a.stride >= 0; },
+                          [](const auto&) { return true; } },
+        action);
+}
+
+// Construct the alternative of Action with a given index
+template <size_t I = 0>
+bool emplace_action(Action& action, size_t index)
+{
+    if constexpr (I < std::variant_size_v<Action>) {
+        if (index == I) {
+            action.emplace<I>();
+            return true;
+        }
+        return emplace_action<I + 1>(action, index);
+    } else
+        return false;
+}
+
+}
+
+void apply(WatercolourEngine& engine, std::array<BuiltinStamp, 4>& stamps, const Action& action)
+{
+    std::visit(Overloaded {
+                   [&](const action::Reset& a) {
+                       engine.reset(a.size, a.format);
+                       engine.random.seed = a.seed;
+                   },
+                   [&](const action::SetSettings& a) { engine.settings = a.settings; },
+                   [&](const action::SetStamp& a) { stamps[a.index] = a.stamp; },
+                   [&](const action::BeginStroke& a) {
+                       Stamp& stamp = as_stamp(stamps[a.stamp]);
+                       engine.place(stamp, a.pos, a.brush);
+                       engine.begin_stroke();
+                       engine.wet_canvas(stamp, a.pos, a.brush.size);
+                   },
+                   [&](const action::PaintSegment& a) { engine.paint_segment(stamps[a.stamp], a.start, a.dir, a.steps, a.spacing, a.brush); },
+                   [&](const action::EndStroke&) { engine.end_stroke(); },
+                   [&](const action::AddWater& a) { engine.add_water(a.pos, a.radius); },
+                   [&](const action::SweepWater& a) { engine.add_water(a.from, a.to, a.radius); },
+                   [&](const action::Undo&) { engine.undo(); },
+                   [&](const action::Redo&) { engine.redo(); },
+                   [&](const action::Resample&) { engine.resample(); },
+                   [&](const action::SetResampleStride& a) { engine.resample_stride = a.stride; },
+                   [&](const action::Mark&) {} },
+        action);
+}
+
+Journal::Journal()
+    : bytes(magic.begin(), magic.end())
+{
+}
+
+void Journal::record(uint32_t tick, const Action& action)
+{
+    bytes.push_back((unsigned char)action.index());
+    put_varint(bytes, tick);
+    std::visit(Overloaded {
+                   [&](const action::SetStamp& a) {
+                       put(bytes, a.index);
+                       put_stamp(bytes, a.stamp);
+                   },
+                   [&](const auto& a) { fields(a, [&](const auto& field) { put(bytes, field); return true; }); } },
+        action);
+}
+
+bool Journal::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)bytes.data(), bytes.size());
+    return (bool)file;
+}
+
+bool Journal::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    bytes.resize((size_t)file.tellg());
+    file.seekg(0);
+    if (!file.read((char*)bytes.data(), (std::streamsize)bytes.size()))
+        return false;
+    return bytes.size() >= magic.size() && std::equal(magic.begin(), magic.end(), bytes.begin());
+}
+
+bool Journal::Reader::next(uint32_t& tick, Action& action)
+{
+    if (pos >= bytes.size() || !emplace_action(action, bytes[pos++]))
+        return false;
+
+    tick = 0;
+    for (int shift = 0;; shift += 7) {
+        if (pos >= bytes.size() || shift > 28)
+            return false;
+        const unsigned char byte = bytes[pos++];
+        tick |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+
+    const bool complete = std::visit(Overloaded {
+                                         [&](action::SetStamp& a) { return get(a.index) && get_stamp(*this, a.stamp); },
+                                         [&](auto& a) { return fields(a, [&](auto& field) { return get(field); }); } },
+        action);
+    return complete && valid(action);
+}
+
+Image replay(const Journal& journal, int threads, ReplayStats& stats)
+{
+    WatercolourEngine engine(glm::ivec2(1, 1));
+    std::array<BuiltinStamp, 4> stamps = { Crunchy {}, WetOnDry {}, WetOnWet {}, Blobby {} };
+    Image image(glm::ivec2(1, 1), glm::vec3(0.0f));
+    std::vector<glm::vec2> points;
+    const auto fill = [&](const glm::vec4& color, std::span<const glm::vec2> outline) { image.fill(outline, color); };
+
+    const auto start = std::chrono::steady_clock::now();
+    Journal::Reader reader = journal.reader();
+    uint32_t tick;
+    Action action;
+    size_t action_pos = reader.pos; // Of the action being read
+    for (; reader.next(tick, action); action_pos = reader.pos) {
+        // Splats are drawn onto the canvas after every tick, the renderer does so whenever it takes a snapshot
+        for (; engine.ticks < tick; stats.ticks++) {
+            engine.tick();
+            engine.take_retired(fill);
+        }
+
+        if (const action::Mark* mark = std::get_if<action::Mark>(&action)) {
+            if (mark->fingerprint != engine.fingerprint() && stats.diverged_marks++ == 0)
+                stats.diverged_tick = tick;
+            stats.marks++;
+        }
+        apply(engine, stamps, action);
+        stats.actions++;
+        if (const action::Reset* reset = std::get_if<action::Reset>(&action))
+            image = Image(reset->size, reset->background);
+        if (threads >= 0)
+            engine.settings.threads = threads;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.truncated = action_pos < journal.bytes.size();
+
+    engine.take_retired(fill);
+    engine.splats.for_each([&](const Splat& splat, ConstVertexSpan vertices) {
+        points.clear();
+        for (size_t i = 0; i < vertices.size(); i++)
+            points.push_back(vertices.pos(i));
+        image.fill(points, splat.color);
+    });
+    return image;
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "engine.hpp"
+#include "raster.hpp"
+
+// Everything that changes the state of the simulation other than ticking, as recorded in a journal.
+// Each action is applied between ticks, so replaying them at the same ticks reproduces the session exactly.
+namespace action {
+
+struct Reset {
+    glm::ivec2 size;
+    WetMapFormat format;
+    glm::vec3 background; // Colour of the blank canvas, only used for drawing
+    uint64_t seed = 0; // Of the engine's random numbers
+};
+
+struct SetSettings {
+    Settings settings;
+};
+
+struct SetStamp {
+    uint8_t index;
+    BuiltinStamp stamp;
+};
+
+// Start a stroke with a stamp, wetting the canvas around it
+struct BeginStroke {
+    uint8_t stamp;
+    glm::vec2 pos;
+    Brush brush;
+};
+
+// See WatercolourEngine::paint_segment
+struct PaintSegment {
+    uint8_t stamp;
+    glm::vec2 start, dir;
+    int steps, spacing;
+    Brush brush;
+};
+
+struct EndStroke {
+};
+
+struct AddWater {
+    glm::vec2 pos;
+    float radius;
+};
+
+struct SweepWater {
+    glm::vec2 from, to;
+    float radius;
+};
+
+struct Undo {
+};
+
+struct Redo {
+};
+
+struct Resample {
+};
+
+// The scheduler shedding or restoring periodic resampling, which changes how the splats move
+struct SetResampleStride {
+    int stride;
+};
+
+// A point the journal was saved at. Saving always ends the journal with one, replaying checks the engine at each and carries on.
+struct Mark {
+    uint64_t fingerprint; // Of the engine at that point, a replay which does not reach the same state has diverged
+};
+
+}
+
+// The order of these is part of the journal format
+using Action = std::variant<action::Reset, action::SetSettings, action::SetStamp, action::BeginStroke, action::PaintSegment, action::EndStroke,
+    action::AddWater, action::SweepWater, action::Undo, action::Redo, action::Resample, action::SetResampleStride, action::Mark>;
+
+// Apply an action to an engine and the stamps it paints with
+void apply(WatercolourEngine& engine, std::array<BuiltinStamp, 4>& stamps, const Action& action);
+
+// The actions of a session with the ticks they were applied before, in a compact binary format: a header, then for each action
+// its index in Action, the tick as a variable-length integer and then each of its fields in turn, as the field is laid out in memory.
+// Journals are only meant to be replayed by the build that recorded them.
+struct Journal {
+
+    static constexpr std::array<unsigned char, 4> magic = { 'W', 'C', 'J', '1' };
+
+    std::vector<unsigned char> bytes;
+
+    // Reads the actions of a journal back in order
+    struct Reader {
+        const std::vector<unsigned char>& bytes;
+        size_t pos = magic.size();
+
+        // Read the next action, return false at the end of the journal, if it is corrupt or if the action could not have been recorded
+        bool next(uint32_t& tick, Action& action);
+
+        // Read a scalar or a glm vector, return false if there are not enough bytes left or a bool is neither 0 nor 1
+        template <typename T>
+        bool get(T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T> && !std::is_empty_v<T>);
+            if constexpr (std::is_same_v<T, bool>) {
+                uint8_t byte;
+                if (!get(byte) || byte > 1)
+                    return false;
+                value = byte == 1;
+                return true;
+            } else {
+                if (bytes.size() - pos < sizeof(T))
+                    return false;
+                std::memcpy(&value, bytes.data() + pos, sizeof(T));
+                pos += sizeof(T);
+                return true;
+            }
+        }
+    };
+
+    Journal();
+
+    void record(uint32_t tick, const Action& action);
+
+    // Return false if the file could not be written
+    bool save(const std::string& path) const;
+
+    // Return false if the file could not be read or is not a journal
+    bool load(const std::string& path);
+
+    Reader reader() const { return { bytes }; }
+};
+
+// Statistics of a replay
+struct ReplayStats {
+    uint64_t ticks = 0, actions = 0;
+    double seconds = 0.0; // Spent replaying, not counting drawing the live splats at the end
+    uint64_t marks = 0, diverged_marks = 0; // Marks reached, and those at which the engine was not in the recorded state
+    uint32_t diverged_tick = 0; // Of the first mark at which the replay diverged
+    bool truncated = false; // The journal had a corrupt or invalid action, replaying stopped just before it
+};
+
+// Replay a whole journal as fast as possible, compositing splats as they dry as the renderer does,
+// and return the canvas with the splats still live drawn over it. The recorded number of threads is used unless threads >= 0.
+// The engine is checked against the fingerprint of every mark.
+Image replay(const Journal& journal, int threads, ReplayStats& stats);
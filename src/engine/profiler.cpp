@@ -0,0 +1,68 @@
+#include "profiler.hpp"
+
+#include <fstream>
+#include <iomanip>
+
+namespace {
+
+// Shared by every trace so that events from different threads line up, set when the program starts
+const Trace::Clock::time_point epoch = Trace::Clock::now();
+
+const char* thread_name(uint32_t thread)
+{
+    return thread == 0 ? "Render" : thread == 1 ? "Simulation" : "Simulation worker";
+}
+
+}
+
+double Trace::time(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::micro>(t - epoch).count();
+}
+
+bool Trace::write_chrome_json(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << std::fixed << std::setprecision(3);
+
+    // Name the threads which have events, so the viewer shows what each one is
+    std::vector<bool> named;
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const char* separator = "\n";
+    for (const TraceEvent& event : events) {
+        if (event.thread >= named.size())
+            named.resize(event.thread + 1);
+        if (!named[event.thread]) {
+            file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << event.thread << ",\"args\":{\"name\":\"" << thread_name(event.thread);
+            if (event.thread > 1)
+                file << " " << event.thread - 1;
+            file << "\"}}";
+            named[event.thread] = true;
+            separator = ",\n";
+        }
+
+        file << separator << "{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.time;
+        if (event.type == TraceEvent::Span)
+            file << ",\"ph\":\"X\",\"dur\":" << event.value << "}";
+        else
+            file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+        separator = ",\n";
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
+
+bool Trace::write_csv(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << std::fixed << std::setprecision(3);
+
+    file << "type,name,thread,time_us,value\n";
+    for (const TraceEvent& event : events)
+        file << (event.type == TraceEvent::Span ? "span" : "counter") << "," << event.name << "," << event.thread << "," << event.time << "," << event.value << "\n";
+    return (bool)file;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The latest samples of a measurement, for drawing as a histogram
+struct History {
+
+    static constexpr size_t capacity = 120;
+
+    std::array<float, capacity> samples {};
+    size_t next = 0; // Index the next sample is written to, which holds the oldest sample once the history is full
+
+    void add(float sample)
+    {
+        samples[next] = sample;
+        next = (next + 1) % capacity;
+    }
+
+    float max() const { return *std::max_element(samples.begin(), samples.end()); }
+};
+
+// Work done by the engine during a tick
+struct TickCounters {
+    uint64_t advected_vertices = 0; // Flowing vertices the engine tried to move
+    uint64_t rejected_moves = 0; // Of those, moves rejected for leaving the wet area
+    uint64_t pool_resizes = 0; // Ticks since the canvas was created in which the capacity of the splat pool changed, not counting the wet map or scratch space
+    size_t bytes = 0; // Held by the splat pool and the wet map
+
+    TickCounters& operator+=(const TickCounters& counters)
+    {
+        advected_vertices += counters.advected_vertices;
+        rejected_moves += counters.rejected_moves;
+        return *this;
+    }
+};
+
+// A span of time spent on one thread, or a sample of a counter
+struct TraceEvent {
+
+    enum Type : uint8_t {
+        Span,
+        Counter
+    };
+
+    Type type;
+    const char* name; // A string literal
+    uint32_t thread; // 0 for the render thread, 1 + the worker index for the simulation's threads
+    double time; // Microseconds since the trace clock's epoch
+    double value; // Duration of a span in microseconds, or the value of a counter
+};
+
+// Events recorded while tracing, to be exported as a Chrome trace (for chrome://tracing or Perfetto) or as CSV.
+// Each thread records into a trace of its own, merged by appending.
+struct Trace {
+
+    using Clock = std::chrono::steady_clock;
+
+    bool recording = false;
+    std::vector<TraceEvent> events;
+
+    // Microseconds since the epoch shared by all traces
+    static double time(Clock::time_point t);
+    static double now() { return time(Clock::now()); }
+
+    void span(const char* name, uint32_t thread, double start, double end)
+    {
+        if (recording)
+            events.push_back({ TraceEvent::Span, name, thread, start, end - start });
+    }
+
+    void counter(const char* name, double time, double value)
+    {
+        if (recording)
+            events.push_back({ TraceEvent::Counter, name, 0, time, value });
+    }
+
+    void append(const std::vector<TraceEvent>& more)
+    {
+        if (recording)
+            events.insert(events.end(), more.begin(), more.end());
+    }
+
+    // Write the events in the Chrome trace event format, return false if the file could not be written
+    bool write_chrome_json(const std::string& path) const;
+
+    // Write the events as comma separated values, one per line, return false if the file could not be written
+    bool write_csv(const std::string& path) const;
+};
+
+// Times the scope it lives in, adding its duration in milliseconds to a history and a span to a trace
+struct ScopedTimer {
+
+    History& history;
+    Trace& trace;
+    const char* name;
+    uint32_t thread;
+    Trace::Clock::time_point start;
+
+    ScopedTimer(History& samples, Trace& events, const char* span_name, uint32_t span_thread = 0)
+        : history(samples)
+        , trace(events)
+        , name(span_name)
+        , thread(span_thread)
+        , start(Trace::Clock::now())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        const Trace::Clock::time_point end = Trace::Clock::now();
+        history.add(std::chrono::duration<float, std::milli>(end - start).count());
+        trace.span(name, thread, Trace::time(start), Trace::time(end));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
@@ -0,0 +1,54 @@
+#include "random.hpp"
+
+namespace {
+
+constexpr uint32_t philox_m0 = 0xD2511F53, philox_m1 = 0xCD9E8D57;
+constexpr uint32_t philox_w0 = 0x9E3779B9, philox_w1 = 0xBB67AE85;
+constexpr int philox_rounds = 10;
+
+}
+
+Random::Block Random::operator()(uint32_t index, uint32_t id, uint32_t tick, Stream stream) const
+{
+    Block c { index, id, tick, stream };
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    for (int r = 0; r < philox_rounds; r++) {
+        const uint64_t p0 = (uint64_t)philox_m0 * c[0];
+        const uint64_t p1 = (uint64_t)philox_m1 * c[2];
+        c = { (uint32_t)(p1 >> 32) ^ c[1] ^ k0, (uint32_t)p1, (uint32_t)(p0 >> 32) ^ c[3] ^ k1, (uint32_t)p0 };
+        k0 += philox_w0;
+        k1 += philox_w1;
+    }
+    return c;
+}
+
+void Random::fill_lanes(uint32_t first, uint32_t id, uint32_t tick, Stream stream, float (*out)[simd_lanes], int n) const
+{
+    // The same rounds as operator(), one array per counter word so that the compiler can vectorise across lanes
+    uint32_t c0[simd_lanes], c1[simd_lanes], c2[simd_lanes], c3[simd_lanes];
+    for (int l = 0; l < simd_lanes; l++) {
+        c0[l] = first + l;
+        c1[l] = id;
+        c2[l] = tick;
+        c3[l] = stream;
+    }
+
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    for (int r = 0; r < philox_rounds; r++) {
+        for (int l = 0; l < simd_lanes; l++) {
+            const uint64_t p0 = (uint64_t)philox_m0 * c0[l];
+            const uint64_t p1 = (uint64_t)philox_m1 * c2[l];
+            c0[l] = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+            c1[l] = (uint32_t)p1;
+            c2[l] = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+            c3[l] = (uint32_t)p0;
+        }
+        k0 += philox_w0;
+        k1 += philox_w1;
+    }
+
+    const uint32_t* words[4] = { c0, c1, c2, c3 };
+    for (int k = 0; k < n; k++)
+        for (int l = 0; l < simd_lanes; l++)
+            out[k][l] = to_unit(words[k][l]);
+}
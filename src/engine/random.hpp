@@ -0,0 +1,41 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+#include "simd.hpp"
+
+// Counter-based random number generator (Philox4x32-10).
+// Every sample is a pure function of the seed and a counter made of an index, the id of a splat, the tick and a stream,
+// so a tick draws the same numbers no matter which thread updates which splat, or in which order.
+struct Random {
+
+    // What the samples are used for, so that different uses never share a counter
+    enum Stream : uint32_t {
+        Advect,
+        Rewet,
+        Resample,
+        Stamp
+    };
+
+    using Block = std::array<uint32_t, 4>;
+
+    uint64_t seed = 0;
+
+    // Return four independent 32-bit samples for a counter
+    Block operator()(uint32_t index, uint32_t id, uint32_t tick, Stream stream) const;
+
+    // Return a sample of U(a, b) for a counter
+    float uniform(float a, float b, uint32_t index, uint32_t id, uint32_t tick, Stream stream) const
+    {
+        return a + (b - a) * to_unit((*this)(index, id, tick, stream)[0]);
+    }
+
+    // Fill out[k][l], for k < n <= 4, with samples of U(0, 1) for the indices first + l of simd_lanes consecutive lanes
+    void fill_lanes(uint32_t first, uint32_t id, uint32_t tick, Stream stream, float (*out)[simd_lanes], int n) const;
+
+    // Map a 32-bit sample to [0, 1)
+    static float to_unit(uint32_t x)
+    {
+        return (x >> 8) * (1.0f / (1 << 24));
+    }
+};
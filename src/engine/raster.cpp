@@ -0,0 +1,58 @@
+#include "raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+unsigned char to_byte(float c)
+{
+    return (unsigned char)std::lround(255.0f * std::clamp(c, 0.0f, 1.0f));
+}
+
+}
+
+Image::Image(const glm::ivec2& image_size, const glm::vec3& background)
+    : size(image_size)
+    , pixels(3 * (size_t)image_size.x * image_size.y)
+{
+    for (size_t i = 0; i < pixels.size(); i += 3) {
+        pixels[i] = to_byte(background.r);
+        pixels[i + 1] = to_byte(background.g);
+        pixels[i + 2] = to_byte(background.b);
+    }
+}
+
+void Image::fill(std::span<const glm::vec2> points, const glm::vec4& color)
+{
+    if (points.size() < 3)
+        return;
+
+    glm::vec2 min = points[0], max = points[0];
+    for (const glm::vec2& p : points) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    // Pixels whose centres lie between pairs of crossings of the outline along their row are inside
+    const int y_begin = std::max((int)std::ceil(min.y - 0.5f), 0), y_end = std::min((int)std::ceil(max.y - 0.5f), size.y);
+    for (int y = y_begin; y < y_end; y++) {
+        const float yc = y + 0.5f;
+        crossings.clear();
+        for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+            const glm::vec2 a = points[j], b = points[i];
+            if ((a.y <= yc) != (b.y <= yc))
+                crossings.push_back(a.x + (yc - a.y) * (b.x - a.x) / (b.y - a.y));
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        for (size_t k = 0; k + 1 < crossings.size(); k += 2) {
+            const int x_begin = std::max((int)std::ceil(crossings[k] - 0.5f), 0);
+            const int x_end = std::min((int)std::ceil(crossings[k + 1] - 0.5f), size.x);
+            unsigned char* pixel = pixels.data() + 3 * ((size_t)size.x * y + x_begin);
+            for (int x = x_begin; x < x_end; x++, pixel += 3)
+                for (int c = 0; c < 3; c++)
+                    pixel[c] = to_byte(color.a * color[c] + (1.0f - color.a) * pixel[c] / 255.0f);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+// An 8-bit RGB image of the canvas drawn in software, for running without OpenGL.
+// Rows are stored bottom first, as in the canvas texture.
+struct Image {
+
+    glm::ivec2 size;
+    std::vector<unsigned char> pixels;
+    std::vector<float> crossings; // Scratch space for filling polygons
+
+    Image(const glm::ivec2& image_size, const glm::vec3& background);
+
+    // Blend a splat over the image, filling its outline by the even-odd rule at pixel centres as the renderer does with the stencil buffer
+    void fill(std::span<const glm::vec2> points, const glm::vec4& color);
+};
@@ -0,0 +1,92 @@
+#include "scheduler.hpp"
+
+namespace {
+
+// Weight of the latest sample in the averaged statistics
+const float smoothing = 0.05f;
+
+float seconds(TickScheduler::Clock::duration d)
+{
+    return std::chrono::duration<float>(d).count();
+}
+
+}
+
+TickScheduler::TickScheduler()
+    : last_frame(Clock::now())
+    , last_change(last_frame)
+{
+}
+
+void TickScheduler::run(WatercolourEngine& engine, int tps)
+{
+    const Clock::time_point now = Clock::now();
+    const float dt = seconds(now - last_frame);
+    last_frame = now;
+    frame_time += smoothing * (dt - frame_time);
+
+    if (tps <= 0) {
+        time_accum = 0.0;
+        return;
+    }
+
+    // Always run a tick when one is due, then catch up for as long as the budget allows
+    const double time_step = 1.0 / (double)tick_rate(tps);
+    time_accum += (double)dt;
+    for (int n = 0; time_accum >= time_step; n++) {
+        const Clock::time_point start = Clock::now();
+        if (n > 0 && seconds(start - now) >= catch_up_budget)
+            break;
+
+        late_ticks += time_accum >= 2.0 * time_step;
+        engine.tick();
+        tick_time += smoothing * (seconds(Clock::now() - start) - tick_time);
+        time_accum -= time_step;
+        ticks++;
+    }
+
+    // Ticks still due cannot be caught up without stalling the next frame as well
+    const bool dropped = time_accum >= time_step;
+    if (dropped) {
+        const uint64_t n = (uint64_t)(time_accum / time_step);
+        dropped_ticks += n;
+        time_accum -= n * time_step;
+    }
+
+    load = tick_time * tick_rate(tps);
+    govern(engine, now, dropped);
+}
+
+void TickScheduler::govern(WatercolourEngine& engine, Clock::time_point now, bool dropped)
+{
+    if (!degrade)
+        level = Degradation::None;
+    else if (seconds(now - last_change) >= level_period) {
+        // Shed one level of work at a time, and restore it only once the load is well below the threshold,
+        // so that the level does not flip back and forth as the load drops with each level
+        if ((load > high_load || dropped) && level != Degradation::LowerRate) {
+            level = (Degradation)((int)level + 1);
+            last_change = now;
+        } else if (load < low_load && level != Degradation::None) {
+            level = (Degradation)((int)level - 1);
+            last_change = now;
+        }
+    }
+
+    engine.resample_stride = level == Degradation::None ? 1 : level == Degradation::SlowResampling ? 2 : 0;
+}
+
+const char* TickScheduler::name(Degradation level)
+{
+    switch (level) {
+    case Degradation::None:
+        return "none";
+    case Degradation::SlowResampling:
+        return "slow resampling";
+    case Degradation::NoResampling:
+        return "no resampling";
+    case Degradation::LowerRate:
+        return "half tick rate";
+    }
+    return "";
+}
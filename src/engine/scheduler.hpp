@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+#include "engine.hpp"
+
+// How much simulation work the scheduler sheds to keep up with the tick rate, in the order it is shed
+enum class Degradation : uint8_t {
+    None,
+    SlowResampling, // Resample splat boundaries half as often
+    NoResampling, // Only resample splats as they become fixed
+    LowerRate // Also tick at half the rate, the simulation running slower than real time
+};
+
+// Runs the engine at a fixed tick rate from a steady clock, called once per frame.
+// Ticks which fall behind are caught up within a budget of time per frame, beyond which they are dropped
+// rather than letting the frame rate collapse, and sustained load sheds work by degrading the simulation.
+struct TickScheduler {
+
+    using Clock = std::chrono::steady_clock;
+
+    float catch_up_budget = 0.025f; // Seconds of ticking per frame, after the first tick
+    bool degrade = true; // Degrade the simulation under load, or always run it in full
+    float high_load = 0.75f, low_load = 0.3f; // Fractions of real time spent ticking above which work is shed, and below which it is restored
+    float level_period = 0.5f; // Seconds between changes of degradation level
+
+    Clock::time_point last_frame, last_change;
+    double time_accum = 0.0; // Seconds of simulation due but not yet ticked
+    Degradation level = Degradation::None;
+
+    // Statistics, averaged over recent frames
+    float frame_time = 0.0f, tick_time = 0.0f; // Seconds per frame and per tick
+    float load = 0.0f; // Fraction of real time spent ticking
+    uint64_t ticks = 0, late_ticks = 0, dropped_ticks = 0; // Ticks run, run behind schedule to catch up, and skipped
+
+    TickScheduler();
+
+    // Run the ticks due since the last frame at tps ticks per second, 0 to pause
+    void run(WatercolourEngine& engine, int tps);
+
+    // Tick rate at the current level of degradation
+    float tick_rate(int tps) const
+    {
+        return level == Degradation::LowerRate ? tps / 2.0f : (float)tps;
+    }
+
+    // Move between degradation levels from the measured load
+    void govern(WatercolourEngine& engine, Clock::time_point now, bool dropped);
+
+    static const char* name(Degradation level);
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Instruction set of the SIMD kernels, chosen at compile time.
+// AVX2 has to be enabled explicitly (WATERCOLOUR_AVX2 in CMake), SSE2 is part of every x86-64 target.
+#if defined(__AVX2__)
+#define WATERCOLOUR_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WATERCOLOUR_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// Number of vertices the advection kernel processes at once, one AVX register of floats.
+// The rewetted and flowing masks of a group fit in a byte.
+constexpr int simd_lanes = 8;
+constexpr size_t simd_alignment = 32;
+
+// Allocator aligning arrays to the width of an AVX register
+template <typename T>
+struct AlignedAllocator {
+
+    using value_type = T;
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) { }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(simd_alignment)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        ::operator delete(p, std::align_val_t(simd_alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,136 @@
+#include "simulation.hpp"
+
+#include <chrono>
+
+Simulation::Simulation(const glm::ivec2& size, const glm::vec3& background)
+    : engine(size)
+    , thread([this]() { run(); })
+{
+    // Start the journal from a known state, so that replays do not depend on the defaults.
+    // The thread is already running, the copies are taken before any command can change what they copy.
+    const Settings settings = engine.settings;
+    const std::array<BuiltinStamp, 4> initial_stamps = stamps;
+    perform(action::Reset { size, WetMapFormat::Float, background, seed });
+    perform(action::SetSettings { settings });
+    for (size_t i = 0; i < initial_stamps.size(); i++)
+        perform(action::SetStamp { (uint8_t)i, initial_stamps[i] });
+}
+
+Simulation::~Simulation()
+{
+    stopping.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+void Simulation::send(Command&& command)
+{
+    while (!commands.push(std::move(command)))
+        std::this_thread::yield();
+}
+
+void Simulation::perform(Action&& action)
+{
+    send([action = std::move(action)](Simulation& simulation) {
+        simulation.journal.record(simulation.engine.ticks, action);
+        apply(simulation.engine, simulation.stamps, action);
+    });
+}
+
+void Simulation::reset(const glm::ivec2& size, WetMapFormat format, const glm::vec3& background)
+{
+    // One command, so that no snapshot can be published between the reset and the new generation:
+    // it would export the new wet map under the old generation, and the renderer would discard it
+    send([action = Action(action::Reset { size, format, background, seed })](Simulation& simulation) {
+        simulation.journal.record(simulation.engine.ticks, action);
+        apply(simulation.engine, simulation.stamps, action);
+        simulation.generation++;
+        simulation.wet_map_version = -1;
+    });
+}
+
+void Simulation::save_journal(const std::string& path)
+{
+    send([path](Simulation& simulation) {
+        simulation.journal.record(simulation.engine.ticks, action::Mark { simulation.engine.fingerprint() });
+        simulation.journal.save(path);
+    });
+}
+
+void Simulation::run()
+{
+    while (!stopping.load(std::memory_order_relaxed)) {
+        Command command;
+        while (commands.pop(command)) {
+            command(*this);
+            changed = true;
+        }
+
+        const uint64_t ticks = scheduler.ticks;
+        scheduler.run(engine, tps);
+        changed |= scheduler.ticks != ticks;
+
+        // Shedding resampling changes how splats move, so replays have to shed it at the same ticks
+        if (engine.resample_stride != journalled_stride) {
+            journal.record(engine.ticks, action::SetResampleStride { engine.resample_stride });
+            journalled_stride = engine.resample_stride;
+        }
+
+        // Snapshots are only built once the renderer has taken the last one, there is no point in building more than it draws
+        Snapshot* snapshot = snapshots.back();
+        if (snapshot && (changed || (export_wet_map.load(std::memory_order_relaxed) && wet_map_version != engine.wet_map.version))) {
+            publish(*snapshot);
+            changed = false;
+        } else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Simulation::publish(Snapshot& snapshot)
+{
+    snapshot.generation = generation;
+    snapshot.live.clear();
+    snapshot.dried.clear();
+    snapshot.points.clear();
+    engine.take_retired([&](const glm::vec4& color, std::span<const glm::vec2> points) {
+        snapshot.dried.push_back({ color, (uint32_t)snapshot.points.size(), (uint32_t)points.size() });
+        snapshot.points.insert(snapshot.points.end(), points.begin(), points.end());
+    });
+    engine.splats.for_each([&](const Splat& splat, ConstVertexSpan vertices) {
+        snapshot.live.push_back({ splat.color, (uint32_t)snapshot.points.size(), vertices.count });
+        for (size_t i = 0; i < vertices.size(); i++)
+            snapshot.points.push_back(vertices.pos(i));
+    });
+
+    snapshot.wet_patches.clear();
+    snapshot.wet_pixels.clear();
+    if (export_wet_map.load(std::memory_order_relaxed) && wet_map_version != engine.wet_map.version) {
+        engine.wet_map.export_rgba8([&](const glm::ivec2& min, const glm::ivec2& size, const unsigned char* pixels) {
+            snapshot.wet_patches.push_back({ min, size, snapshot.wet_pixels.size() });
+            snapshot.wet_pixels.insert(snapshot.wet_pixels.end(), pixels, pixels + 4 * size.x * size.y);
+        });
+        wet_map_version = engine.wet_map.version;
+    }
+
+    snapshot.stroke_id = engine.stroke_id;
+    snapshot.live_splats = engine.splats.live.size;
+    snapshot.undone_splats = engine.splats.undone.size;
+    snapshot.sleeping_splats = engine.sleeping.size();
+    snapshot.vertices = engine.splats.vertex_count;
+    snapshot.frozen_vertices = engine.splats.cold_x.size() - engine.splats.cold_garbage;
+    snapshot.wet_map_bytes_per_pixel = engine.wet_map.bytes_per_pixel();
+    snapshot.wet_map_format = engine.wet_map.format;
+    snapshot.tick_time = scheduler.tick_time;
+    snapshot.load = scheduler.load;
+    snapshot.late_ticks = scheduler.late_ticks;
+    snapshot.dropped_ticks = scheduler.dropped_ticks;
+    snapshot.level = scheduler.level;
+    snapshot.phase_times = engine.phase_times;
+    snapshot.critical_path = engine.critical_path();
+    snapshot.phase_history = engine.phase_history;
+    snapshot.counters = engine.counters;
+    snapshot.advected_history = engine.advected_history;
+    snapshot.rejected_history = engine.rejected_history;
+    snapshot.trace_events.swap(engine.trace.events);
+    engine.trace.events.clear();
+    snapshots.publish();
+}
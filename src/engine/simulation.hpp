@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <functional>
+#include <glm/glm.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+#include "journal.hpp"
+#include "scheduler.hpp"
+#include "spsc_queue.hpp"
+
+// Everything the renderer needs from the simulation at one point in time, read-only once published
+struct Snapshot {
+
+    // A rectangle of the wet map which changed, as 8-bit RGBA
+    struct WetPatch {
+        glm::ivec2 min, size;
+        size_t offset; // Of its first pixel in wet_pixels
+    };
+
+    uint32_t generation = 0; // Number of times the canvas was reset before this snapshot
+    std::vector<SplatShape> live; // Live splats in painting order
+    std::vector<SplatShape> dried; // Splats retired since the previous snapshot, to be drawn onto the canvas in this order
+    std::vector<glm::vec2> points;
+    std::vector<WetPatch> wet_patches; // Changes to the wet map since the previous snapshot which exported it
+    std::vector<unsigned char> wet_pixels;
+
+    // Statistics
+    int stroke_id = 0;
+    size_t live_splats = 0, undone_splats = 0, sleeping_splats = 0, vertices = 0, frozen_vertices = 0;
+    int wet_map_bytes_per_pixel = 0;
+    WetMapFormat wet_map_format = WetMapFormat::Float;
+    float tick_time = 0.0f, load = 0.0f;
+    uint64_t late_ticks = 0, dropped_ticks = 0;
+    Degradation level = Degradation::None;
+    std::array<PhaseTime, tick_phase_count> phase_times;
+    uint8_t critical_path = 0; // Bit mask of the phases on the critical path of a tick
+    std::array<History, tick_phase_count> phase_history;
+    TickCounters counters;
+    History advected_history, rejected_history;
+    std::vector<TraceEvent> trace_events; // Recorded since the previous snapshot
+};
+
+// Two snapshots passed from the simulation thread to the renderer without locking.
+// The simulation only writes the snapshot the renderer is not reading, and only once the renderer has taken the last one published,
+// so every published snapshot is seen exactly once.
+struct SnapshotBuffer {
+
+    std::array<Snapshot, 2> snapshots;
+    std::atomic<int> published = 1;
+    std::atomic<bool> taken = true;
+
+    // Return the snapshot the simulation may write, or nullptr if the renderer has not taken the last one yet
+    Snapshot* back()
+    {
+        return taken.load(std::memory_order_acquire) ? &snapshots[1 - published.load(std::memory_order_relaxed)] : nullptr;
+    }
+
+    // Hand the snapshot returned by back() over to the renderer
+    void publish()
+    {
+        published.store(1 - published.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        taken.store(false, std::memory_order_release);
+    }
+
+    // Take the latest snapshot published, or return nullptr if there is none the renderer has not taken already.
+    // The snapshot stays valid until the next call.
+    const Snapshot* take()
+    {
+        if (taken.load(std::memory_order_acquire))
+            return nullptr;
+        const Snapshot* snapshot = &snapshots[published.load(std::memory_order_relaxed)];
+        taken.store(true, std::memory_order_release);
+        return snapshot;
+    }
+};
+
+// Runs the engine on a thread of its own, so that slow ticks do not hold up input or drawing.
+// The engine is only ever touched from that thread: other threads send it commands, which run between ticks in the order they were sent,
+// and read what they need from the snapshots it publishes. Commands which change the painting are performed as actions and journalled.
+struct Simulation {
+
+    using Command = std::function<void(Simulation&)>;
+
+    WatercolourEngine engine;
+    TickScheduler scheduler;
+    int tps = 60;
+    uint32_t generation = 0;
+    int wet_map_version = -1; // Version of the wet map when it was last exported
+    bool changed = true; // Whether anything changed since the last snapshot was published
+    std::array<BuiltinStamp, 4> stamps = { Crunchy {}, WetOnDry {}, WetOnWet {}, Blobby {} }; // As copied from the menu, for painting with
+    Journal journal; // Every action performed since the simulation started
+    int journalled_stride = 1; // The engine's resample stride as last recorded in the journal
+    uint64_t seed = 0; // Of the random numbers of every canvas
+
+    SpscQueue<Command, 4096> commands;
+    SnapshotBuffer snapshots;
+    std::atomic<bool> export_wet_map = true; // Whether snapshots should carry the changes to the wet map
+    std::atomic<bool> stopping = false;
+    std::thread thread;
+
+    Simulation(const glm::ivec2& size, const glm::vec3& background);
+    ~Simulation();
+
+    // Run a command on the simulation thread, waiting for room in the queue if the simulation has fallen far behind
+    void send(Command&& command);
+
+    // Apply an action on the simulation thread, recording it in the journal
+    void perform(Action&& action);
+
+    // Discard all splats and start over with a blank canvas, snapshots from before then have an older generation
+    void reset(const glm::ivec2& size, WetMapFormat format, const glm::vec3& background);
+
+    // Mark the current point in the journal and write it to a file
+    void save_journal(const std::string& path);
+
+    // The simulation thread's loop
+    void run();
+
+    // Fill the back snapshot and publish it
+    void publish(Snapshot& snapshot);
+};
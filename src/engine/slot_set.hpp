@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Unordered set of SplatPool slots with O(1) insertion and removal
+struct SlotSet {
+
+    static constexpr uint32_t none = UINT32_MAX;
+
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> positions; // Indexed by slot, none if the slot is not in the set
+
+    size_t size() const { return slots.size(); }
+    bool empty() const { return slots.empty(); }
+
+    bool contains(uint32_t slot) const
+    {
+        return slot < positions.size() && positions[slot] != none;
+    }
+
+    void insert(uint32_t slot)
+    {
+        if (slot >= positions.size())
+            positions.resize(slot + 1, none);
+        positions[slot] = (uint32_t)slots.size();
+        slots.push_back(slot);
+    }
+
+    void erase(uint32_t slot)
+    {
+        const uint32_t last = slots.back();
+        slots[positions[slot]] = last;
+        positions[last] = positions[slot];
+        positions[slot] = none;
+        slots.pop_back();
+    }
+
+    void clear()
+    {
+        for (uint32_t slot : slots)
+            positions[slot] = none;
+        slots.clear();
+    }
+};
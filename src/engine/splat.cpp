@@ -0,0 +1,295 @@
+#include "splat.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+
+// Inputs to the advection of one group of vertices which are the same for every lane
+struct AdvectParams {
+    glm::vec2 bias; // Already scaled by 1 - alpha
+    glm::vec2 gravity; // Already scaled by the gravity strength
+    float flow;
+    glm::vec2 max; // Upper bound of clamp_point
+    const uint64_t* wet_bits;
+    int words_per_row;
+};
+
+// Random samples of one group: u[0] = U(1, 1 + r) and u[1], u[2] = U(-r, r)
+struct AdvectSamples {
+    alignas(simd_alignment) float u[3][simd_lanes];
+};
+
+#if defined(WATERCOLOUR_SIMD_AVX2)
+
+// Advect the flowing lanes of a group, returning the lanes whose move was accepted
+uint8_t advect_group(const AdvectParams& p, const AdvectSamples& samples, uint8_t flowing, float* x, float* y, const float* vx, const float* vy)
+{
+    const __m256 alpha_v = _mm256_set1_ps(alpha);
+    const __m256 flow_v = _mm256_set1_ps(p.flow);
+
+    // d = (1 - alpha) * b + alpha * (1 / U(1, 1 + r)) * v
+    const __m256 k = _mm256_mul_ps(alpha_v, _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_load_ps(samples.u[0])));
+    const __m256 dx = _mm256_add_ps(_mm256_set1_ps(p.bias.x), _mm256_mul_ps(k, _mm256_load_ps(vx)));
+    const __m256 dy = _mm256_add_ps(_mm256_set1_ps(p.bias.y), _mm256_mul_ps(k, _mm256_load_ps(vy)));
+
+    // x* = x_t + f * d + g + U(-r, r), clamped to the canvas (max_ps returns its second operand for NaN)
+    const __m256 x_t = _mm256_load_ps(x), y_t = _mm256_load_ps(y);
+    __m256 xs = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(x_t, _mm256_mul_ps(flow_v, dx)), _mm256_set1_ps(p.gravity.x)), _mm256_load_ps(samples.u[1]));
+    __m256 ys = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(y_t, _mm256_mul_ps(flow_v, dy)), _mm256_set1_ps(p.gravity.y)), _mm256_load_ps(samples.u[2]));
+    xs = _mm256_min_ps(_mm256_max_ps(xs, _mm256_setzero_ps()), _mm256_set1_ps(p.max.x));
+    ys = _mm256_min_ps(_mm256_max_ps(ys, _mm256_setzero_ps()), _mm256_set1_ps(p.max.y));
+
+    // Gather the word of the wet mask holding each pixel and shift its bit into the sign bit
+    const __m256i ix = _mm256_cvttps_epi32(xs), iy = _mm256_cvttps_epi32(ys);
+    const __m256i word = _mm256_add_epi32(_mm256_mullo_epi32(iy, _mm256_set1_epi32(p.words_per_row)), _mm256_srli_epi32(ix, WetMask::tile_shift));
+    const __m256i shift = _mm256_sub_epi32(_mm256_set1_epi32(63), _mm256_and_si256(ix, _mm256_set1_epi32(WetMask::tile_size - 1)));
+    const long long* bits = reinterpret_cast<const long long*>(p.wet_bits);
+    const __m256i lo = _mm256_sllv_epi64(_mm256_i32gather_epi64(bits, _mm256_castsi256_si128(word), 8), _mm256_cvtepi32_epi64(_mm256_castsi256_si128(shift)));
+    const __m256i hi = _mm256_sllv_epi64(_mm256_i32gather_epi64(bits, _mm256_extracti128_si256(word, 1), 8), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(shift, 1)));
+    const int wet = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) | _mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4;
+
+    // x_t+1 = x* if w(x*) > 0 else x_t
+    const uint8_t accepted = flowing & wet;
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 select = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(accepted), lane_bits), lane_bits));
+    _mm256_store_ps(x, _mm256_blendv_ps(x_t, xs, select));
+    _mm256_store_ps(y, _mm256_blendv_ps(y_t, ys, select));
+    return accepted;
+}
+
+#elif defined(WATERCOLOUR_SIMD_SSE2)
+
+uint8_t advect_group(const AdvectParams& p, const AdvectSamples& samples, uint8_t flowing, float* x, float* y, const float* vx, const float* vy)
+{
+    const __m128 alpha_v = _mm_set1_ps(alpha);
+    const __m128 flow_v = _mm_set1_ps(p.flow);
+    uint8_t accepted = 0;
+
+    // Two halves of four lanes, SSE2 has no gather so the wet mask is tested lane by lane
+    for (int h = 0; h < simd_lanes; h += 4) {
+        const __m128 k = _mm_mul_ps(alpha_v, _mm_div_ps(_mm_set1_ps(1.0f), _mm_load_ps(samples.u[0] + h)));
+        const __m128 dx = _mm_add_ps(_mm_set1_ps(p.bias.x), _mm_mul_ps(k, _mm_load_ps(vx + h)));
+        const __m128 dy = _mm_add_ps(_mm_set1_ps(p.bias.y), _mm_mul_ps(k, _mm_load_ps(vy + h)));
+
+        const __m128 x_t = _mm_load_ps(x + h), y_t = _mm_load_ps(y + h);
+        __m128 xs = _mm_add_ps(_mm_add_ps(_mm_add_ps(x_t, _mm_mul_ps(flow_v, dx)), _mm_set1_ps(p.gravity.x)), _mm_load_ps(samples.u[1] + h));
+        __m128 ys = _mm_add_ps(_mm_add_ps(_mm_add_ps(y_t, _mm_mul_ps(flow_v, dy)), _mm_set1_ps(p.gravity.y)), _mm_load_ps(samples.u[2] + h));
+        xs = _mm_min_ps(_mm_max_ps(xs, _mm_setzero_ps()), _mm_set1_ps(p.max.x));
+        ys = _mm_min_ps(_mm_max_ps(ys, _mm_setzero_ps()), _mm_set1_ps(p.max.y));
+
+        alignas(16) float xs_out[4], ys_out[4];
+        alignas(16) int ix[4], iy[4];
+        _mm_store_ps(xs_out, xs);
+        _mm_store_ps(ys_out, ys);
+        _mm_store_si128(reinterpret_cast<__m128i*>(ix), _mm_cvttps_epi32(xs));
+        _mm_store_si128(reinterpret_cast<__m128i*>(iy), _mm_cvttps_epi32(ys));
+
+        for (int l = 0; l < 4; l++)
+            if (flowing >> (h + l) & 1 && p.wet_bits[(size_t)iy[l] * p.words_per_row + (ix[l] >> WetMask::tile_shift)] >> (ix[l] & (WetMask::tile_size - 1)) & 1) {
+                x[h + l] = xs_out[l];
+                y[h + l] = ys_out[l];
+                accepted |= 1 << (h + l);
+            }
+    }
+    return accepted;
+}
+
+#else
+
+uint8_t advect_group(const AdvectParams& p, const AdvectSamples& samples, uint8_t flowing, float* x, float* y, const float* vx, const float* vy)
+{
+    uint8_t accepted = 0;
+    for (int l = 0; l < simd_lanes; l++) {
+        if (!(flowing >> l & 1))
+            continue;
+
+        const float k = alpha * (1.0f / samples.u[0][l]);
+        const glm::vec2 d = p.bias + k * glm::vec2(vx[l], vy[l]);
+        const glm::vec2 x_star = glm::clamp(glm::vec2(x[l], y[l]) + p.flow * d + p.gravity + glm::vec2(samples.u[1][l], samples.u[2][l]), glm::vec2(0.0f), p.max);
+        const int ix = (int)x_star.x, iy = (int)x_star.y;
+        if (p.wet_bits[(size_t)iy * p.words_per_row + (ix >> WetMask::tile_shift)] >> (ix & (WetMask::tile_size - 1)) & 1) {
+            x[l] = x_star.x;
+            y[l] = x_star.y;
+            accepted |= 1 << l;
+        }
+    }
+    return accepted;
+}
+
+#endif
+
+}
+
+template <typename Planes>
+bool Splat::advect(VertexSpan vertices, const WetMap& wet_map, const Planes& planes, float gravity, const Random& random, uint32_t tick, TickCounters& counters)
+{
+    // d = (1 - alpha) * b + alpha * (1 / U(1, 1 + r)) * v
+    // x* = x_t + f * d + g + U(-r, r)
+    // x_t+1 = x* if w(x*) > 0 else x_t
+    // Where U(a, b) is a uniform random variable between a and b
+    const AdvectParams params {
+        (1.0f - alpha) * bias,
+        gravity * g,
+        flow,
+        glm::vec2(wet_map.size) - 0.001f,
+        wet_map.wet.bits.data(),
+        wet_map.wet.words_per_row
+    };
+    AdvectSamples samples;
+    uint8_t moved = 0;
+
+    for (size_t group = 0; group < vertices.groups(); group++) {
+        const size_t base = group * simd_lanes;
+
+        // Rewetted vertices have their velocity sampled from the wet map
+        if (const uint8_t rewetted = vertices.rewetted_bits[group]) {
+            for (int l = 0; l < simd_lanes; l++)
+                if (rewetted >> l & 1) {
+                    const glm::vec2 vel = planes.velocity(planes.index(vertices.pos(base + l)));
+                    vertices.vx[base + l] = vel.x;
+                    vertices.vy[base + l] = vel.y;
+                    if (wet_map.saturated.test(vertices.pos(base + l)))
+                        vertices.flowing_bits[group] |= 1 << l;
+                }
+        }
+
+        const uint8_t flowing = vertices.flowing_bits[group];
+        if (!flowing)
+            continue;
+
+        // Samples for all lanes at once, those of lanes which are not flowing are ignored
+        random.fill_lanes((uint32_t)base, id, tick, Random::Advect, samples.u, 3);
+        for (int l = 0; l < simd_lanes; l++) {
+            samples.u[0][l] = 1.0f + roughness * samples.u[0][l];
+            samples.u[1][l] = -roughness + 2.0f * roughness * samples.u[1][l];
+            samples.u[2][l] = -roughness + 2.0f * roughness * samples.u[2][l];
+        }
+
+        const uint8_t accepted = advect_group(params, samples, flowing, vertices.x + base, vertices.y + base, vertices.vx + base, vertices.vy + base);
+        moved |= accepted;
+        counters.advected_vertices += std::popcount(flowing);
+        counters.rejected_moves += std::popcount((uint8_t)(flowing & ~accepted));
+    }
+
+    stalled = moved ? 0 : stalled + 1;
+    return life(tick) <= 0;
+}
+
+bool Splat::age(VertexSpan vertices, const WetMap& wet_map, int new_lifetime, float unfixing_strength, const Random& random, uint32_t tick)
+{
+    // Nothing can have been rewetted if no water was added since the last tick
+    if (wet_map.saturated.empty())
+        return false;
+
+    for (size_t i = 0; i < vertices.size(); i++)
+        if (wet_map.saturated.test(vertices.pos(i))) {
+            // Rewet splat
+            for (size_t j = 0; j < vertices.size(); j++) {
+                const bool rewetted = random.uniform(0.0f, 1.0f, (uint32_t)j, id, tick, Random::Rewet) < std::pow(unfixing_strength, -life(tick) / 10.0f);
+                vertices.set(j, { vertices.pos(j), glm::vec2(0.0f, 0.0f), rewetted, wet_map.saturated.test(vertices.pos(j)) });
+            }
+            bias = glm::vec2(0.0f, 0.0f);
+            fix_tick = tick + new_lifetime;
+            return true;
+        }
+
+    return false;
+}
+
+template bool Splat::advect(VertexSpan, const WetMap&, const FloatWetPlanes&, float, const Random&, uint32_t, TickCounters&);
+template bool Splat::advect(VertexSpan, const WetMap&, const Compact8WetPlanes&, float, const Random&, uint32_t, TickCounters&);
+template bool Splat::advect(VertexSpan, const WetMap&, const Compact16WetPlanes&, float, const Random&, uint32_t, TickCounters&);
+
+uint32_t Splat::adaptive_count(ConstVertexSpan vertices, float spacing, float scale, int min, int max) const
+{
+    // Measure a subsample of the boundary of a fixed number of vertices, as the jitter of individual vertices
+    // adds to the perimeter the closer together they are, which would feed back into ever more vertices
+    const int n = vertices.size(), m = std::min(n, 16);
+    float perimeter = 0.0f, area = 0.0f;
+    for (int k = 0; k < m; k++) {
+        const glm::vec2 a = vertices.pos(k * n / m), b = vertices.pos((k + 1) % m * n / m);
+        perimeter += glm::distance(a, b);
+        area += a.x * b.y - a.y * b.x; // Shoelace formula
+    }
+    area = 0.5f * std::abs(area);
+
+    // The isoperimetric ratio is 1 for a disc and grows the more the boundary curves back and forth
+    const float ratio = area > 0.0f ? perimeter * perimeter / (4.0f * glm::pi<float>() * area) : 1.0f;
+    const float target = perimeter / spacing * std::sqrt(std::max(ratio, 1.0f)) * scale;
+    return (uint32_t)std::clamp((int)std::ceil(target), min, max);
+}
+
+void Splat::resample(VertexSpan vertices, ResampleScratch& scratch, const Random& random, uint32_t tick, uint32_t n_out)
+{
+    const int n = vertices.size();
+    const int m = n_out;
+    const int start = random(0, id, tick, Random::Resample)[0] % n;
+
+    // Edge lengths, edge k runs from vertex k to k + 1 and the last one closes the boundary
+    std::vector<float>& lengths = scratch.lengths;
+    lengths.resize(n);
+    for (int k = 0; k < n - 1; k++) {
+        const float dx = vertices.x[k + 1] - vertices.x[k], dy = vertices.y[k + 1] - vertices.y[k];
+        lengths[k] = std::sqrt(dx * dx + dy * dy);
+    }
+    lengths[n - 1] = glm::distance(vertices.pos(n - 1), vertices.pos(0));
+
+    // Prefix sum of the edge lengths, starting from the edge at the start vertex
+    std::vector<float>& offsets = scratch.offsets;
+    offsets.resize(n + 1);
+    offsets[0] = 0.0f;
+    for (int k = start; k < n; k++)
+        offsets[k - start + 1] = offsets[k - start] + lengths[k];
+    for (int k = 0; k < start; k++)
+        offsets[n - start + k + 1] = offsets[n - start + k] + lengths[k];
+    const float inc = offsets[n] / m;
+
+    VertexArrays& out = scratch.vertices;
+    out.resize((m + simd_lanes - 1) / simd_lanes * simd_lanes);
+    std::fill(out.rewetted.begin(), out.rewetted.end(), 0);
+    std::fill(out.flowing.begin(), out.flowing.end(), 0);
+
+    // Walk the new vertices and the edges together, both are in order of arc length
+    int e = 0;
+    for (int j = 0; j < m; j++) {
+        const float s = j * inc;
+        while (s > offsets[e + 1] && e < n - 1)
+            e++;
+
+        // Add new vertex, interpolate its properties between a and b
+        const int a = start + e < n ? start + e : start + e - n;
+        const int b = a + 1 < n ? a + 1 : 0;
+        const float t = s - offsets[e];
+        const float d = offsets[e + 1] - offsets[e];
+        const float f = d > 0.0f ? t / d : 0.0f;
+        out.x[j] = vertices.x[a] + f * (vertices.x[b] - vertices.x[a]);
+        out.y[j] = vertices.y[a] + f * (vertices.y[b] - vertices.y[a]);
+        out.vx[j] = t * vertices.vx[b] + (d - t) * vertices.vx[a];
+        out.vy[j] = t * vertices.vy[b] + (d - t) * vertices.vy[a];
+
+        const int from = t < d - t ? a : b;
+        out.rewetted[j / simd_lanes] |= vertices.rewetted(from) << (j % simd_lanes);
+        out.flowing[j / simd_lanes] |= vertices.flowing(from) << (j % simd_lanes);
+    }
+
+    // Normalise the interpolated velocities in a separate pass, which vectorises
+    for (int j = 0; j < m; j++) {
+        const float l = std::sqrt(out.vx[j] * out.vx[j] + out.vy[j] * out.vy[j]);
+        const float k = l > 0.0f ? 1.0f / l : 0.0f;
+        out.vx[j] *= k;
+        out.vy[j] *= k;
+    }
+
+    // Copy the new vertices over the old ones, whole groups of masks so that padding lanes stay clear.
+    // Padding lanes keep the positions of old vertices, which lie inside the canvas.
+    std::copy_n(out.x.begin(), m, vertices.x);
+    std::copy_n(out.y.begin(), m, vertices.y);
+    std::copy_n(out.vx.begin(), m, vertices.vx);
+    std::copy_n(out.vy.begin(), m, vertices.vy);
+    std::copy(out.rewetted.begin(), out.rewetted.end(), vertices.rewetted_bits);
+    std::copy(out.flowing.begin(), out.flowing.end(), vertices.flowing_bits);
+    count = m;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <type_traits>
+#include <vector>
+
+#include "profiler.hpp"
+#include "random.hpp"
+#include "simd.hpp"
+#include "wet_map.hpp"
+
+const float alpha = 0.33f;
+const glm::vec2 g = glm::vec2(0.0f, -1.0f);
+
+// A single vertex, unpacked from the vertex arrays
+struct Vertex {
+    glm::vec2 pos;
+    glm::vec2 vel;
+    bool rewetted = false;
+    bool flowing = true;
+};
+
+// The vertices of all splats as a structure of arrays, so that the advection kernel can work on simd_lanes vertices at once.
+// Each splat's vertices start at a multiple of simd_lanes, padded with vertices which are neither rewetted nor flowing.
+// rewetted and flowing hold one bit per vertex, one byte per group of simd_lanes vertices.
+struct VertexArrays {
+
+    AlignedVector<float> x, y, vx, vy;
+    AlignedVector<uint8_t> rewetted, flowing;
+
+    size_t size() const { return x.size(); }
+
+    void resize(size_t n)
+    {
+        x.resize(n);
+        y.resize(n);
+        vx.resize(n);
+        vy.resize(n);
+        rewetted.resize(n / simd_lanes);
+        flowing.resize(n / simd_lanes);
+    }
+};
+
+static_assert(simd_lanes == 8, "Vertex masks are stored as one byte per group");
+
+// Pointers to the vertices of one splat in a VertexArrays, T is const float for a read-only view
+template <typename T>
+struct VertexView {
+
+    using Mask = std::conditional_t<std::is_const_v<T>, const uint8_t, uint8_t>;
+
+    T *x, *y, *vx, *vy;
+    Mask *rewetted_bits, *flowing_bits;
+    uint32_t count;
+
+    VertexView(T* xs, T* ys, T* vxs, T* vys, Mask* rewetted, Mask* flowing, uint32_t n)
+        : x(xs)
+        , y(ys)
+        , vx(vxs)
+        , vy(vys)
+        , rewetted_bits(rewetted)
+        , flowing_bits(flowing)
+        , count(n)
+    {
+    }
+
+    // A mutable view converts to a read-only one
+    template <typename U>
+        requires std::is_convertible_v<U*, T*>
+    VertexView(const VertexView<U>& other)
+        : VertexView(other.x, other.y, other.vx, other.vy, other.rewetted_bits, other.flowing_bits, other.count)
+    {
+    }
+
+    size_t size() const { return count; }
+
+    // Number of groups of simd_lanes vertices, including the padding
+    size_t groups() const { return (count + simd_lanes - 1) / simd_lanes; }
+
+    glm::vec2 pos(size_t i) const { return glm::vec2(x[i], y[i]); }
+    glm::vec2 vel(size_t i) const { return glm::vec2(vx[i], vy[i]); }
+    bool rewetted(size_t i) const { return rewetted_bits[i / simd_lanes] >> (i % simd_lanes) & 1; }
+    bool flowing(size_t i) const { return flowing_bits[i / simd_lanes] >> (i % simd_lanes) & 1; }
+
+    // Return the bounding box of the vertices
+    void bounds(glm::vec2& min, glm::vec2& max) const
+    {
+        min = max = pos(0);
+        for (size_t i = 1; i < count; i++) {
+            min.x = std::min(min.x, x[i]);
+            max.x = std::max(max.x, x[i]);
+        }
+        for (size_t i = 1; i < count; i++) {
+            min.y = std::min(min.y, y[i]);
+            max.y = std::max(max.y, y[i]);
+        }
+    }
+
+    Vertex get(size_t i) const
+    {
+        return { pos(i), vel(i), rewetted(i), flowing(i) };
+    }
+
+    void set(size_t i, const Vertex& v) const
+    {
+        x[i] = v.pos.x;
+        y[i] = v.pos.y;
+        vx[i] = v.vel.x;
+        vy[i] = v.vel.y;
+        set_bit(rewetted_bits, i, v.rewetted);
+        set_bit(flowing_bits, i, v.flowing);
+    }
+
+    static void set_bit(Mask* bits, size_t i, bool value)
+    {
+        const uint8_t bit = uint8_t(1) << (i % simd_lanes);
+        bits[i / simd_lanes] = value ? bits[i / simd_lanes] | bit : bits[i / simd_lanes] & ~bit;
+    }
+};
+
+using VertexSpan = VertexView<float>;
+using ConstVertexSpan = VertexView<const float>;
+
+// Scratch space for resampling, one per thread, reused so that resampling does not allocate once it has grown large enough
+struct ResampleScratch {
+    std::vector<float> lengths; // Edge lengths in vertex order
+    std::vector<float> offsets; // Arc length at the start of each edge, starting from the edge resampling starts at
+    VertexArrays vertices; // The resampled vertices, copied over the splat's once complete
+};
+
+// A splat's header, its vertices are stored contiguously with those of all other splats in a SplatPool
+struct Splat {
+
+    glm::vec2 bias;
+    glm::vec4 color;
+    float size, roughness, flow;
+    int stroke_id;
+    uint32_t id; // Unique among all splats of a pool, keys the splat's random samples
+    uint32_t fix_tick; // Last tick the splat flows for, relative to the tick it was undone at while undone
+    uint32_t first, count; // Range of the splat's vertices in the pool
+    uint32_t stalled = 0; // Ticks since any vertex last moved
+
+    // Lifetime left at the start of a tick, the splat is fixed once it is negative
+    int life(uint32_t tick) const
+    {
+        return (int)(fix_tick - tick);
+    }
+
+    // Return the furthest a vertex can move in one tick
+    float reach(float gravity) const
+    {
+        // Velocities sampled from the wet map can be as long as sqrt(2), and 1 / U(1, 1 + r) is at most 1
+        const float sqrt2 = 1.41421356f;
+        return flow * ((1.0f - alpha) * glm::length(bias) + alpha * sqrt2) + gravity + roughness * sqrt2 + 1.0f;
+    }
+
+    // Advect each vertex, counting the moves tried and rejected, return true iff this was the last tick of the splat's lifetime
+    template <typename Planes>
+    bool advect(VertexSpan vertices, const WetMap& wet_map, const Planes& planes, float gravity, const Random& random, uint32_t tick, TickCounters& counters);
+
+    // If the fixed splat has just been rewetted, give it a new lifetime and return true
+    bool age(VertexSpan vertices, const WetMap& wet_map, int new_lifetime, float unfixing_strength, const Random& random, uint32_t tick);
+
+    // Return the number of vertices for the splat's boundary to have vertices about spacing / scale apart,
+    // more where it curves more, within [min, max]
+    uint32_t adaptive_count(ConstVertexSpan vertices, float spacing, float scale, int min, int max) const;
+
+    // Resample the splat's boundary into n_out evenly spaced vertices, which must fit in the padded size of its vertices
+    void resample(VertexSpan vertices, ResampleScratch& scratch, const Random& random, uint32_t tick, uint32_t n_out);
+};
@@ -0,0 +1,38 @@
+#include "splat_grid.hpp"
+
+#include <algorithm>
+
+SplatGrid::SplatGrid(const glm::ivec2& canvas_size)
+    : size((canvas_size + WetMask::tile_size - 1) / WetMask::tile_size)
+    , cells((size_t)size.x * size.y)
+{
+}
+
+SplatGrid::Range SplatGrid::cells_of(const glm::vec2& min, const glm::vec2& max) const
+{
+    const glm::ivec2 lo = glm::ivec2(min) >> WetMask::tile_shift, hi = glm::ivec2(max) >> WetMask::tile_shift;
+    return { glm::min(glm::max(lo, 0), size - 1), glm::min(glm::max(hi, 0), size - 1) };
+}
+
+void SplatGrid::update(uint32_t slot, const Range& range)
+{
+    if (slot >= ranges.size())
+        ranges.resize(slot + 1);
+
+    Range& old = ranges[slot];
+    if (old == range)
+        return;
+
+    for (int y = old.min.y; y <= old.max.y; y++)
+        for (int x = old.min.x; x <= old.max.x; x++) {
+            std::vector<uint32_t>& c = cells[y * size.x + x];
+            *std::find(c.begin(), c.end(), slot) = c.back();
+            c.pop_back();
+        }
+
+    for (int y = range.min.y; y <= range.max.y; y++)
+        for (int x = range.min.x; x <= range.max.x; x++)
+            cells[y * size.x + x].push_back(slot);
+
+    old = range;
+}
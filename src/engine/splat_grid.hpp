@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "wet_mask.hpp"
+
+// Uniform grid over the canvas binning splats by their bounding boxes, with cells the size of the wet map's tiles,
+// so that the splats a tile of water may have reached can be found without looking at all of them.
+// Splats are identified by their slot in the SplatPool.
+struct SplatGrid {
+
+    // Range of cells a splat is binned in, inclusive, empty if min.x > max.x
+    struct Range {
+        glm::ivec2 min { 0, 0 }, max { -1, -1 };
+
+        bool empty() const { return min.x > max.x; }
+        bool operator==(const Range&) const = default;
+    };
+
+    glm::ivec2 size; // Number of cells
+    std::vector<std::vector<uint32_t>> cells;
+    std::vector<Range> ranges; // Indexed by slot
+
+    SplatGrid(const glm::ivec2& canvas_size);
+
+    // Return the cells overlapped by a box of canvas coordinates
+    Range cells_of(const glm::vec2& min, const glm::vec2& max) const;
+
+    // Bin a splat in a range of cells, moving it if it was already binned elsewhere
+    void update(uint32_t slot, const Range& range);
+
+    // Take a splat out of the grid
+    void remove(uint32_t slot)
+    {
+        update(slot, Range());
+    }
+
+    // Return the splats binned in a cell
+    const std::vector<uint32_t>& cell(int x, int y) const
+    {
+        return cells[y * size.x + x];
+    }
+};
@@ -0,0 +1,315 @@
+#include "splat_pool.hpp"
+
+#include <algorithm>
+
+#include "unit_circle.hpp"
+
+namespace {
+
+template <typename T>
+void grow(T& vector, size_t size)
+{
+    if (size > vector.capacity())
+        vector.reserve(std::max(size, 2 * vector.capacity()));
+}
+
+}
+
+SplatHandle SplatPool::emplace(const WetGrid& grid, const glm::vec2& pos, const glm::vec4& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices, const glm::vec2& bias)
+{
+    uint32_t index;
+    if (free_slots.size() > 0) {
+        index = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        index = (uint32_t)splats.size();
+        splats.emplace_back();
+        states.push_back(State::Free);
+        generations.push_back(0);
+        prev.push_back(none);
+        next.push_back(none);
+        cold.push_back(0);
+        cold_boxes.emplace_back();
+    }
+
+    // Vertices are always appended to the end of the vertex arrays
+    const uint32_t first = (uint32_t)vertices.size();
+    vertices.resize(first + padded_count(n_vertices));
+    splats[index] = { bias, color, size, roughness, flow, stroke_id, next_id++, fix_tick, first, (uint32_t)n_vertices };
+
+    const VertexSpan v = vertices_of(splats[index]);
+    unit_circle::for_each(n_vertices, [&](int i, const glm::vec2& dir) { v.set(i, { grid.clamp_point(pos + size * dir), dir }); });
+
+    // Padding vertices never move, but are kept inside the canvas for the kernel's wet map lookups
+    for (uint32_t i = n_vertices; i < padded_count(n_vertices); i++)
+        v.set(i, { v.pos(0), glm::vec2(0.0f, 0.0f), false, false });
+
+    states[index] = State::Live;
+    link(live, index);
+    vertex_count += n_vertices;
+    return { index, generations[index] };
+}
+
+void SplatPool::reserve(size_t n_splats, size_t n_vertices)
+{
+    const size_t slots = splats.size() + (n_splats > free_slots.size() ? n_splats - free_slots.size() : 0);
+    grow(splats, slots);
+    grow(states, slots);
+    grow(generations, slots);
+    grow(prev, slots);
+    grow(next, slots);
+    grow(cold, slots);
+    grow(cold_boxes, slots);
+
+    const size_t size = vertices.size() + n_vertices;
+    grow(vertices.x, size);
+    grow(vertices.y, size);
+    grow(vertices.vx, size);
+    grow(vertices.vy, size);
+    grow(vertices.rewetted, size / simd_lanes);
+    grow(vertices.flowing, size / simd_lanes);
+}
+
+void SplatPool::retire(uint32_t index)
+{
+    unlink(states[index] == State::Live ? live : undone, index);
+    states[index] = State::Free;
+    generations[index]++;
+    free_slots.push_back(index);
+
+    vertex_count -= splats[index].count;
+    if (cold[index]) {
+        cold[index] = 0;
+        cold_garbage += splats[index].count;
+        if (cold_garbage > cold_x.size() / 2)
+            compact_cold();
+    } else {
+        garbage += padded_count(splats[index].count);
+        if (garbage > vertices.size() / 2)
+            compact();
+    }
+}
+
+ConstVertexSpan SplatPool::view(uint32_t index) const
+{
+    const Splat& splat = splats[index];
+    if (!cold[index])
+        return vertices_of(splat);
+
+    thawed.resize(std::max(thawed.size(), (size_t)padded_count(splat.count)));
+    for (uint32_t i = 0; i < splat.count; i++) {
+        const glm::vec2 pos = cold_pos(index, i);
+        thawed.x[i] = pos.x;
+        thawed.y[i] = pos.y;
+    }
+    std::fill_n(thawed.vx.begin(), splat.count, 0.0f);
+    std::fill_n(thawed.vy.begin(), splat.count, 0.0f);
+    std::fill_n(thawed.rewetted.begin(), padded_count(splat.count) / simd_lanes, 0);
+    std::fill_n(thawed.flowing.begin(), padded_count(splat.count) / simd_lanes, 0);
+    return ConstVertexSpan(thawed.x.data(), thawed.y.data(), thawed.vx.data(), thawed.vy.data(), thawed.rewetted.data(), thawed.flowing.data(), splat.count);
+}
+
+void SplatPool::freeze(uint32_t index)
+{
+    Splat& splat = splats[index];
+    const ConstVertexSpan v = vertices_of(splat);
+    glm::vec2 min, max;
+    v.bounds(min, max);
+    const ColdBox box = { min, (max - min) / 65535.0f };
+    const glm::vec2 scale = glm::vec2(box.step.x > 0.0f ? 1.0f / box.step.x : 0.0f, box.step.y > 0.0f ? 1.0f / box.step.y : 0.0f);
+
+    // Rounding down keeps the decoded vertices inside the box, and so inside the canvas
+    const uint32_t first = (uint32_t)cold_x.size();
+    cold_x.resize(first + splat.count);
+    cold_y.resize(first + splat.count);
+    for (uint32_t i = 0; i < splat.count; i++) {
+        const glm::vec2 q = glm::clamp(glm::floor((v.pos(i) - min) * scale), 0.0f, 65535.0f);
+        cold_x[first + i] = (uint16_t)q.x;
+        cold_y[first + i] = (uint16_t)q.y;
+    }
+
+    cold[index] = 1;
+    cold_boxes[index] = box;
+    garbage += padded_count(splat.count);
+    splat.first = first;
+    if (garbage > vertices.size() / 2)
+        compact();
+}
+
+void SplatPool::thaw(uint32_t index)
+{
+    // Vertices are appended to the end of the vertex arrays, padded as emplace does
+    Splat& splat = splats[index];
+    const uint32_t first = (uint32_t)vertices.size();
+    vertices.resize(first + padded_count(splat.count));
+    const VertexSpan v(vertices.x.data() + first, vertices.y.data() + first, vertices.vx.data() + first, vertices.vy.data() + first,
+        vertices.rewetted.data() + first / simd_lanes, vertices.flowing.data() + first / simd_lanes, splat.count);
+    for (uint32_t i = 0; i < splat.count; i++)
+        v.set(i, { cold_pos(index, i), glm::vec2(0.0f, 0.0f), false, false });
+    for (uint32_t i = splat.count; i < padded_count(splat.count); i++)
+        v.set(i, { v.pos(0), glm::vec2(0.0f, 0.0f), false, false });
+
+    cold[index] = 0;
+    splat.first = first;
+    cold_garbage += splat.count;
+    if (cold_garbage > cold_x.size() / 2)
+        compact_cold();
+}
+
+bool SplatPool::cold_test(uint32_t index, const WetMask& mask) const
+{
+    if (mask.empty())
+        return false;
+
+    for (uint32_t i = 0; i < splats[index].count; i++)
+        if (mask.test(cold_pos(index, i)))
+            return true;
+    return false;
+}
+
+void SplatPool::make_room(uint32_t index, uint32_t n)
+{
+    Splat& splat = splats[index];
+    const uint32_t size = padded_count(splat.count);
+    if (padded_count(n) <= size)
+        return;
+
+    // Copy the vertices to a bigger block at the end, padded with copies of the first as emplace does
+    const uint32_t first = (uint32_t)vertices.size();
+    vertices.resize(first + padded_count(n));
+    std::copy_n(vertices.x.begin() + splat.first, size, vertices.x.begin() + first);
+    std::copy_n(vertices.y.begin() + splat.first, size, vertices.y.begin() + first);
+    std::copy_n(vertices.vx.begin() + splat.first, size, vertices.vx.begin() + first);
+    std::copy_n(vertices.vy.begin() + splat.first, size, vertices.vy.begin() + first);
+    std::copy_n(vertices.rewetted.begin() + splat.first / simd_lanes, size / simd_lanes, vertices.rewetted.begin() + first / simd_lanes);
+    std::copy_n(vertices.flowing.begin() + splat.first / simd_lanes, size / simd_lanes, vertices.flowing.begin() + first / simd_lanes);
+    garbage += size;
+    splat.first = first;
+
+    const VertexSpan v = vertices_of(splat);
+    for (uint32_t i = size; i < padded_count(n); i++)
+        v.set(i, { v.pos(0), glm::vec2(0.0f, 0.0f), false, false });
+}
+
+void SplatPool::recounted(uint32_t index, uint32_t before)
+{
+    garbage += padded_count(before) - std::min(padded_count(before), padded_count(splats[index].count));
+    vertex_count += splats[index].count;
+    vertex_count -= before;
+    if (garbage > vertices.size() / 2)
+        compact();
+}
+
+void SplatPool::undo()
+{
+    if (live.size > 0) {
+        const int last_stroke_id = splats[live.tail].stroke_id;
+        while (live.size > 0 && splats[live.tail].stroke_id == last_stroke_id) {
+            const uint32_t index = live.tail;
+            unlink(live, index);
+            link(undone, index);
+            states[index] = State::Undone;
+        }
+    }
+}
+
+void SplatPool::redo()
+{
+    if (undone.size > 0) {
+        const int last_stroke_id = splats[undone.tail].stroke_id;
+        while (undone.size > 0 && splats[undone.tail].stroke_id == last_stroke_id) {
+            const uint32_t index = undone.tail;
+            unlink(undone, index);
+            link(live, index);
+            states[index] = State::Live;
+        }
+    }
+}
+
+void SplatPool::clear_undone()
+{
+    while (undone.size > 0)
+        retire(undone.tail);
+}
+
+void SplatPool::clear()
+{
+    *this = SplatPool();
+}
+
+void SplatPool::link(List& list, uint32_t index)
+{
+    prev[index] = list.tail;
+    next[index] = none;
+    if (list.tail != none)
+        next[list.tail] = index;
+    else
+        list.head = index;
+    list.tail = index;
+    list.size++;
+}
+
+void SplatPool::unlink(List& list, uint32_t index)
+{
+    if (prev[index] != none)
+        next[prev[index]] = next[index];
+    else
+        list.head = next[index];
+    if (next[index] != none)
+        prev[next[index]] = prev[index];
+    else
+        list.tail = prev[index];
+    list.size--;
+}
+
+void SplatPool::compact()
+{
+    VertexArrays compacted;
+    compacted.resize(vertices.size() - garbage);
+    uint32_t first = 0;
+    for (const List* list : { &live, &undone })
+        for (uint32_t i = list->head; i != none; i = next[i]) {
+            if (cold[i])
+                continue;
+            const uint32_t from = splats[i].first, n = padded_count(splats[i].count);
+            std::copy_n(vertices.x.begin() + from, n, compacted.x.begin() + first);
+            std::copy_n(vertices.y.begin() + from, n, compacted.y.begin() + first);
+            std::copy_n(vertices.vx.begin() + from, n, compacted.vx.begin() + first);
+            std::copy_n(vertices.vy.begin() + from, n, compacted.vy.begin() + first);
+            std::copy_n(vertices.rewetted.begin() + from / simd_lanes, n / simd_lanes, compacted.rewetted.begin() + first / simd_lanes);
+            std::copy_n(vertices.flowing.begin() + from / simd_lanes, n / simd_lanes, compacted.flowing.begin() + first / simd_lanes);
+            splats[i].first = first;
+            first += n;
+        }
+
+    vertices = std::move(compacted);
+    garbage = 0;
+}
+
+void SplatPool::compact_cold()
+{
+    std::vector<uint16_t> compacted_x(cold_x.size() - cold_garbage), compacted_y(cold_y.size() - cold_garbage);
+    uint32_t first = 0;
+    for (const List* list : { &live, &undone })
+        for (uint32_t i = list->head; i != none; i = next[i]) {
+            if (!cold[i])
+                continue;
+            const uint32_t from = splats[i].first, n = splats[i].count;
+            std::copy_n(cold_x.begin() + from, n, compacted_x.begin() + first);
+            std::copy_n(cold_y.begin() + from, n, compacted_y.begin() + first);
+            splats[i].first = first;
+            first += n;
+        }
+
+    cold_x = std::move(compacted_x);
+    cold_y = std::move(compacted_y);
+    cold_garbage = 0;
+}
+
+size_t SplatPool::bytes() const
+{
+    const auto held = [](const auto& vector) { return vector.capacity() * sizeof(vector[0]); };
+    return held(splats) + held(states) + held(generations) + held(prev) + held(next) + held(free_slots)
+        + held(vertices.x) + held(vertices.y) + held(vertices.vx) + held(vertices.vy) + held(vertices.rewetted) + held(vertices.flowing)
+        + held(cold) + held(cold_boxes) + held(cold_x) + held(cold_y);
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "splat.hpp"
+#include "wet_map.hpp"
+
+// Stable reference to a splat in a SplatPool, which becomes invalid once the splat is retired
+struct SplatHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Contiguous storage for splats: their headers in one array, indexed by slot, and all of their vertices in a VertexArrays.
+// Live splats are linked in painting order and undone splats in the order they were undone,
+// so any splat can be retired in O(1) without moving the others.
+// The vertices of retired splats are reclaimed by compacting the vertex array once they make up half of it.
+// Splats which no longer move can be frozen into a cold store of positions only, quantised to 16 bits within their bounding box,
+// which takes a quarter of the space and keeps them out of the way of the splats being advected.
+struct SplatPool {
+
+    static constexpr uint32_t none = UINT32_MAX;
+
+    enum class State : uint8_t {
+        Free,
+        Live,
+        Undone
+    };
+
+    // Quantisation grid of a frozen splat, a vertex with coordinates q is at min + step * q
+    struct ColdBox {
+        glm::vec2 min, step;
+    };
+
+    // A list of splats linked through the pool's prev/next arrays
+    struct List {
+        uint32_t head = none, tail = none;
+        size_t size = 0;
+    };
+
+    std::vector<Splat> splats;
+    std::vector<State> states;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> prev, next;
+    std::vector<uint32_t> free_slots;
+    VertexArrays vertices;
+    size_t garbage = 0; // Vertices no splat uses still taking up space in the vertex array
+    size_t vertex_count = 0; // Vertices of all splats, not counting padding
+    uint32_t next_id = 0; // Id given to the next splat
+    List live, undone;
+    std::vector<uint8_t> cold; // Per slot, set if the splat is frozen, its first then indexes the cold arrays
+    std::vector<ColdBox> cold_boxes; // Per slot
+    std::vector<uint16_t> cold_x, cold_y;
+    size_t cold_garbage = 0; // As garbage, in the cold arrays
+    mutable VertexArrays thawed; // Scratch space for viewing frozen splats
+
+    // Add a live splat of n_vertices vertices evenly spaced on a circle, after all others in painting order
+    SplatHandle emplace(const WetGrid& grid, const glm::vec2& pos, const glm::vec4& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices, const glm::vec2& bias = glm::vec2(0.0f, 0.0f));
+
+    // Make room for n_splats more splats with n_vertices vertices in total, including padding,
+    // growing geometrically so that reserving for every batch does not reallocate every time
+    void reserve(size_t n_splats, size_t n_vertices);
+
+    // Return the splat referred to by a handle, or nullptr if it has been retired
+    Splat* get(const SplatHandle& handle)
+    {
+        return handle.index < splats.size() && states[handle.index] != State::Free && generations[handle.index] == handle.generation ? &splats[handle.index] : nullptr;
+    }
+
+    // Return the vertices of a splat which is not frozen
+    VertexSpan vertices_of(const Splat& splat)
+    {
+        return VertexSpan(vertices.x.data() + splat.first, vertices.y.data() + splat.first, vertices.vx.data() + splat.first, vertices.vy.data() + splat.first,
+            vertices.rewetted.data() + splat.first / simd_lanes, vertices.flowing.data() + splat.first / simd_lanes, splat.count);
+    }
+
+    ConstVertexSpan vertices_of(const Splat& splat) const
+    {
+        return ConstVertexSpan(vertices.x.data() + splat.first, vertices.y.data() + splat.first, vertices.vx.data() + splat.first, vertices.vy.data() + splat.first,
+            vertices.rewetted.data() + splat.first / simd_lanes, vertices.flowing.data() + splat.first / simd_lanes, splat.count);
+    }
+
+    // Number of vertices a splat takes up in the vertex arrays, including its padding
+    static uint32_t padded_count(uint32_t count)
+    {
+        return (count + simd_lanes - 1) / simd_lanes * simd_lanes;
+    }
+
+    // Return the position of a vertex of a frozen splat
+    glm::vec2 cold_pos(uint32_t index, uint32_t i) const
+    {
+        const uint32_t k = splats[index].first + i;
+        return cold_boxes[index].min + cold_boxes[index].step * glm::vec2(cold_x[k], cold_y[k]);
+    }
+
+    // Return the vertices of any splat, decoded into scratch space if it is frozen, valid until the next call
+    ConstVertexSpan view(uint32_t index) const;
+
+    // Remove a splat from the pool
+    void retire(uint32_t index);
+
+    // Move a splat's vertex positions into the cold arrays, or back into the vertex arrays with no velocity and no flags set
+    void freeze(uint32_t index);
+    void thaw(uint32_t index);
+
+    // Return true iff any vertex of a frozen splat is on a set pixel of a mask
+    bool cold_test(uint32_t index, const WetMask& mask) const;
+
+    // Make room for a splat to have n vertices, moving its vertices to the end of the vertex arrays if they do not fit where they are
+    void make_room(uint32_t index, uint32_t n);
+
+    // Account for a splat whose number of vertices has changed from before, compacting if that leaves too much garbage
+    void recounted(uint32_t index, uint32_t before);
+
+    // Move the splats of the last live stroke to the undone list, or back
+    void undo();
+    void redo();
+
+    // Retire all undone splats
+    void clear_undone();
+
+    // Retire all splats
+    void clear();
+
+    // Call f with each live splat and its vertices in painting order
+    template <typename F>
+    void for_each(F&& f)
+    {
+        for (uint32_t i = live.head; i != none; i = next[i])
+            f(splats[i], view(i));
+    }
+
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (uint32_t i = live.head; i != none; i = next[i])
+            f(splats[i], view(i));
+    }
+
+    // Append a splat to a list, or remove it
+    void link(List& list, uint32_t index);
+    void unlink(List& list, uint32_t index);
+
+    // Rebuild the vertex array without the vertices of retired splats, in painting order
+    void compact();
+
+    // The same for the cold arrays
+    void compact_cold();
+
+    // Memory held by the pool's arrays, including room reserved for growth
+    size_t bytes() const;
+};
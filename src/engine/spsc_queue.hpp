@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Lock-free ring buffer of up to N - 1 items, for one thread pushing and another popping.
+// Each side only writes its own index, publishing the slots it has filled or emptied with release stores.
+template <typename T, size_t N>
+struct SpscQueue {
+
+    static_assert((N & (N - 1)) == 0, "The capacity must be a power of two");
+
+    std::array<T, N> items;
+    alignas(64) std::atomic<size_t> head = 0; // Next item to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail = 0; // Next slot to push into, written by the producer
+
+    // Push an item, return false if the queue is full
+    bool push(T&& item)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (((t + 1) & (N - 1)) == head.load(std::memory_order_acquire))
+            return false;
+        items[t] = std::move(item);
+        tail.store((t + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    // Pop the oldest item, return false if the queue is empty
+    bool pop(T& item)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = std::move(items[h]);
+        head.store((h + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,99 @@
+#include "stamp.hpp"
+
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+
+// Directions of the discs making up the composite stamps, from the same expressions as they were once computed per call
+const std::array<glm::vec2, 4> axes = [] {
+    std::array<glm::vec2, 4> dirs;
+    for (int i = 0; i < 4; i++) {
+        const float angle = i * 0.5f * glm::pi<float>();
+        dirs[i] = glm::vec2(std::cos(angle), std::sin(angle));
+    }
+    return dirs;
+}();
+
+const std::array<glm::vec2, 4> diagonals = [] {
+    std::array<glm::vec2, 4> dirs;
+    for (int i = 0; i < 4; i++) {
+        const float angle = (i * 0.5f + 0.25f) * glm::pi<float>();
+        dirs[i] = glm::vec2(std::cos(angle), std::sin(angle));
+    }
+    return dirs;
+}();
+
+}
+
+const Footprint& Stamp::footprint(const std::vector<Water>& water, const glm::vec2& phase)
+{
+    for (const Footprint& f : footprints)
+        if (f.matches(water, phase))
+            return f;
+
+    Footprint& f = footprints[next_footprint];
+    next_footprint = (next_footprint + 1) % (int)footprints.size();
+    f.build(water, phase);
+    return f;
+}
+
+void Simple::place(SplatPool& splats, const WetMap& wet_map, const Random&, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices)
+{
+    const glm::vec4 color_a = glm::vec4(color, 0.1f);
+    splats.emplace(wet_map, pos, color_a, size, roughness, flow, stroke_id, fix_tick, n_vertices);
+}
+
+void Crunchy::place(SplatPool& splats, const WetMap& wet_map, const Random&, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices)
+{
+    const glm::vec4 color_a = glm::vec4(color, 0.1f);
+    splats.emplace(wet_map, pos, color_a, scale * size, roughness, flow, stroke_id, fix_tick, n_vertices);
+}
+
+void WetOnDry::place(SplatPool& splats, const WetMap& wet_map, const Random&, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices)
+{
+    const glm::vec4 color_a = glm::vec4(color, 0.02f);
+    const float r = 0.5f * size;
+    splats.emplace(wet_map, pos, color_a, r, roughness, flow, stroke_id, fix_tick, n_vertices);
+    if ((int)lobe_dirs.size() != lobes) {
+        lobe_dirs.resize(lobes);
+        for (int i = 0; i < lobes; i++) {
+            const float angle = i * 2.0f * glm::pi<float>() / lobes;
+            lobe_dirs[i] = glm::vec2(std::cos(angle), std::sin(angle));
+        }
+    }
+    for (int i = 0; i < lobes; i++) {
+        const glm::vec2 offset = r * lobe_dirs[i];
+        const glm::vec2 bias = b * offset;
+        splats.emplace(wet_map, pos + offset, color_a, r, roughness, flow, stroke_id, fix_tick, n_vertices, bias);
+    }
+}
+
+void WetOnWet::place(SplatPool& splats, const WetMap& wet_map, const Random&, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices)
+{
+    const glm::vec4 color_a = glm::vec4(color, 0.05f);
+    splats.emplace(wet_map, pos, color_a, scale * size, roughness, flow, stroke_id, fix_tick, n_vertices);
+    splats.emplace(wet_map, pos, color_a, 0.5f * size, roughness, flow, stroke_id, fix_tick, n_vertices);
+}
+
+void WetOnWet::wet_canvas(std::vector<Water>& water, const glm::vec2& pos, float brush_size)
+{
+    for (const glm::vec2& dir : diagonals)
+        water.push_back({ pos + scale * brush_size * dir, 2.0f * brush_size });
+}
+
+void Blobby::place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices)
+{
+    const glm::vec4 color_a = glm::vec4(color, 0.025f);
+    for (int i = 0; i < 4; i++) {
+        sizes[i] = random.uniform(0.33f, 1.0f, i, splats.next_id, 0, Random::Stamp);
+        const glm::vec2 point = pos + offset * size * axes[i];
+        splats.emplace(wet_map, point, color_a, sizes[i] * size, roughness, flow, stroke_id, fix_tick, n_vertices);
+    }
+}
+
+void Blobby::wet_canvas(std::vector<Water>& water, const glm::vec2& pos, float brush_size)
+{
+    for (int i = 0; i < 4; i++)
+        water.push_back({ pos + offset * brush_size * axes[i], sizes[i] * brush_size });
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <glm/glm.hpp>
+#include <variant>
+#include <vector>
+
+#include "splat_pool.hpp"
+#include "wet_map.hpp"
+
+struct Stamp {
+
+    virtual ~Stamp() = default;
+
+    virtual void place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices) = 0;
+
+    virtual void wet_canvas(std::vector<Water>& water, const glm::vec2& pos, float brush_size) { water.push_back({ pos, brush_size }); }
+
+    // Number of splats placed by each stamp
+    virtual int splat_count() const { return 1; }
+
+    // True iff the shape of the stamp's water changes from one placement to the next, so that its footprints are not worth caching
+    virtual bool varying_water() const { return false; }
+
+    // Return the footprint of the stamp's water, given relative to its position, at a position within a pixel,
+    // rasterising it only if none of the last few built match
+    const Footprint& footprint(const std::vector<Water>& water, const glm::vec2& phase);
+
+    std::array<Footprint, 4> footprints;
+    int next_footprint = 0; // The footprint to be replaced by the next one built
+};
+
+struct Simple final : Stamp {
+    void place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices) override;
+};
+
+struct Crunchy final : Stamp {
+    // Using this as a "Simple+", as the crunchy brush described in the paper can already be achieved by adjusting roughness and flow on the simple brush, with the only missing component being the scale factor.
+    float scale = 1.0f;
+
+    void place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices) override;
+};
+
+struct WetOnDry final : Stamp {
+
+    int lobes = 6;
+    float b = 0.05f;
+    std::vector<glm::vec2> lobe_dirs; // Direction of each lobe, recomputed when the number of lobes changes
+
+    void place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices) override;
+
+    int splat_count() const override { return lobes + 1; }
+};
+
+struct WetOnWet final : Stamp {
+
+    float scale = 1.5f;
+
+    void place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices) override;
+
+    int splat_count() const override { return 2; }
+
+    void wet_canvas(std::vector<Water>& water, const glm::vec2& pos, float brush_size) override;
+};
+
+struct Blobby final : Stamp {
+
+    float offset = 1.0f;
+    std::array<float, 4> sizes { 0.5f, 0.5f, 0.5f, 0.5f };
+
+    void place(SplatPool& splats, const WetMap& wet_map, const Random& random, const glm::vec2& pos, const glm::vec3& color, float size, float roughness, float flow, int stroke_id, uint32_t fix_tick, int n_vertices) override;
+
+    int splat_count() const override { return 4; }
+
+    void wet_canvas(std::vector<Water>& water, const glm::vec2& pos, float brush_size) override;
+
+    // The sizes are drawn for every placement
+    bool varying_water() const override { return true; }
+};
+
+// The stamps offered by the application, in menu order.
+// Placing a stamp through the variant resolves its calls statically, the stamps being final.
+using BuiltinStamp = std::variant<Crunchy, WetOnDry, WetOnWet, Blobby>;
+
+inline Stamp& as_stamp(BuiltinStamp& stamp)
+{
+    return std::visit([](Stamp& s) -> Stamp& { return s; }, stamp);
+}
@@ -0,0 +1,21 @@
+#include "timing_wheel.hpp"
+
+#include <bit>
+
+void TimingWheel::schedule(const Event& event)
+{
+    // The level is that of the highest group of bits in which the due tick differs from the current one
+    const uint32_t diff = event.due ^ now;
+    const int level = diff == 0 ? 0 : (31 - std::countl_zero(diff)) / level_bits;
+    const uint32_t bucket = event.due >> (level_bits * level) & (buckets - 1);
+    wheel[level * buckets + bucket].push_back(event);
+}
+
+void TimingWheel::cascade(int level)
+{
+    std::vector<Event>& bucket = wheel[level * buckets + (now >> (level_bits * level) & (buckets - 1))];
+    firing.swap(bucket);
+    for (const Event& event : firing)
+        schedule(event);
+    firing.clear();
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel: events due at a tick are scheduled and fired in amortised O(1),
+// however far in the future they are. Level l has a bucket for every value of the l-th group of level_bits bits of a tick,
+// events wait in the level of the highest group in which their tick differs from the current one,
+// and are moved down a level each time the current tick reaches the start of their bucket.
+// Events are never cancelled, the owner is expected to ignore those which have become stale when they fire.
+struct TimingWheel {
+
+    static constexpr int level_bits = 8;
+    static constexpr int levels = 4; // Enough for any 32-bit tick
+    static constexpr uint32_t buckets = 1 << level_bits;
+
+    struct Event {
+        uint32_t due;
+        uint32_t slot;
+        uint8_t kind;
+    };
+
+    uint32_t now = 0; // The next tick to fire
+    std::array<std::vector<Event>, levels * buckets> wheel;
+    std::vector<Event> firing; // Scratch space for the events of the current tick
+
+    // Schedule an event, due must not be before now
+    void schedule(const Event& event);
+
+    // Fire the events due at now in the order they were scheduled, then move on to the next tick
+    template <typename F>
+    void advance(F&& fire)
+    {
+        // Bring down the events of the higher levels whose buckets start at this tick
+        for (int l = levels - 1; l > 0; l--)
+            if ((now & ((1u << (level_bits * l)) - 1)) == 0)
+                cascade(l);
+
+        // Events may schedule others for this tick while firing
+        std::vector<Event>& bucket = wheel[now & (buckets - 1)];
+        while (!bucket.empty()) {
+            firing.swap(bucket);
+            for (const Event& event : firing)
+                fire(event);
+            firing.clear();
+        }
+        now++;
+    }
+
+    // Move the events of the current bucket of a level to the levels below
+    void cascade(int level);
+};
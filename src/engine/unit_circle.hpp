@@ -0,0 +1,122 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Points evenly spaced on the unit circle, counter-clockwise from (1, 0), as splats are placed.
+// Tables for the common vertex counts are computed at compile time, other counts fall back to computing them on the fly.
+namespace unit_circle {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Taylor series of sin and cos, accurate to well below float precision on [-pi/4, pi/4]
+constexpr double sin_series(double x)
+{
+    double term = x, sum = x;
+    for (int k = 1; k < 12; k++) {
+        term *= -x * x / ((2 * k) * (2 * k + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos_series(double x)
+{
+    double term = 1.0, sum = 1.0;
+    for (int k = 1; k < 12; k++) {
+        term *= -x * x / ((2 * k - 1) * (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// sin and cos of a non-negative angle, reduced to the nearest multiple of pi/2 so that the series converge quickly
+constexpr double sin(double x)
+{
+    const int quadrant = (int)(x / (pi / 2) + 0.5);
+    const double r = x - quadrant * (pi / 2);
+    switch (quadrant % 4) {
+    case 0:
+        return sin_series(r);
+    case 1:
+        return cos_series(r);
+    case 2:
+        return -sin_series(r);
+    default:
+        return -cos_series(r);
+    }
+}
+
+constexpr double cos(double x)
+{
+    const int quadrant = (int)(x / (pi / 2) + 0.5);
+    const double r = x - quadrant * (pi / 2);
+    switch (quadrant % 4) {
+    case 0:
+        return cos_series(r);
+    case 1:
+        return -sin_series(r);
+    case 2:
+        return -cos_series(r);
+    default:
+        return sin_series(r);
+    }
+}
+
+// The angle of the i-th of n points, rounded to float exactly as the runtime path computes it
+constexpr float angle(int i, int n)
+{
+    return i * 2.0f * (float)pi / n;
+}
+
+template <int N>
+struct Table {
+    std::array<float, N> x, y;
+};
+
+template <int N>
+constexpr Table<N> make_table()
+{
+    Table<N> table {};
+    for (int i = 0; i < N; i++) {
+        table.x[i] = (float)cos(angle(i, N));
+        table.y[i] = (float)sin(angle(i, N));
+    }
+    return table;
+}
+
+template <int N>
+inline constexpr Table<N> table = make_table<N>();
+
+// Call f(i, point) for each of N points from its table, N being known at compile time
+template <int N, typename F>
+void for_each(F&& f)
+{
+    for (int i = 0; i < N; i++)
+        f(i, glm::vec2(table<N>.x[i], table<N>.y[i]));
+}
+
+// Call f(i, point) for each of n points
+template <typename F>
+void for_each(int n, F&& f)
+{
+    switch (n) {
+    case 8:
+        return for_each<8>(f);
+    case 16:
+        return for_each<16>(f);
+    case 25:
+        return for_each<25>(f);
+    case 32:
+        return for_each<32>(f);
+    case 50:
+        return for_each<50>(f);
+    default:
+        for (int i = 0; i < n; i++) {
+            const float a = angle(i, n);
+            f(i, glm::vec2(std::cos(a), std::sin(a)));
+        }
+    }
+}
+
+}
@@ -0,0 +1,461 @@
+#include "wet_map.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "simd.hpp"
+
+namespace {
+
+// Apply the decay pending since the tile was last updated to its stored wetness, rebuilding its wet bits
+template <typename Planes>
+void materialise_tile(Planes& planes, WetMask& wet, WetTile& tile, int tx, int ty, int tick)
+{
+    using W = typename Planes::Wetness;
+    const float elapsed = (float)(tick - tile.last_update) * planes.decay_step + Planes::epsilon;
+    const int x_min = tx * WetMask::tile_size, x_max = std::min(x_min + WetMask::tile_size, planes.size.x);
+    const int y_min = ty * WetMask::tile_size, y_max = std::min(y_min + WetMask::tile_size, planes.size.y);
+
+    float min_wet = (float)Planes::saturated;
+    bool any = false;
+    for (int y = y_min; y < y_max; y++) {
+        W* w = &planes.w[(size_t)planes.size.x * y];
+        uint64_t bits = 0;
+        for (int x = x_min; x < x_max; x++) {
+            if (w[x] == W(0))
+                continue;
+            w[x] = (float)w[x] > elapsed ? W((float)w[x] - elapsed + Planes::epsilon) : W(0);
+            if (w[x] > W(0)) {
+                bits |= uint64_t(1) << (x - x_min);
+                min_wet = std::min(min_wet, (float)w[x]);
+                any = true;
+            }
+        }
+        wet.set_word(y, tx, bits);
+    }
+    wet.update_tile(tx, ty);
+
+    tile.last_update = tick;
+    tile.min_wet = any ? min_wet : 0.0f;
+    tile.active = any;
+}
+
+// Tick at which the first wet pixel of a tile dries
+template <typename Planes>
+int next_dry(const Planes& planes, const WetTile& tile)
+{
+    if (!tile.active)
+        return INT_MAX;
+    if constexpr (std::is_floating_point_v<typename Planes::Wetness>)
+        return tile.last_update + std::max((int)(tile.min_wet / planes.decay_step), 1);
+    else
+        return tile.last_update + ((int)tile.min_wet + planes.decay_step - 1) / planes.decay_step;
+}
+
+template <typename Planes>
+void rasterise_water(Planes& planes, WetMask& wet, WetMask& saturated, const Water& water)
+{
+    // Pixels whose centres fall inside the disc, as rasterised by the GPU
+    const int y_min = std::max((int)std::ceil(water.pos.y - water.radius - 0.5f), 0);
+    const int y_max = std::min((int)std::floor(water.pos.y + water.radius - 0.5f), planes.size.y - 1);
+    for (int y = y_min; y <= y_max; y++) {
+
+        const float dy = y + 0.5f - water.pos.y;
+        const float half_width = std::sqrt(std::max(water.radius * water.radius - dy * dy, 0.0f));
+        const int x_min = std::max((int)std::ceil(water.pos.x - half_width - 0.5f), 0);
+        const int x_max = std::min((int)std::floor(water.pos.x + half_width - 0.5f), planes.size.x - 1);
+
+        if (x_min > x_max)
+            continue;
+
+        // The velocity points outwards from the centre of the disc
+        size_t i = (size_t)planes.size.x * y + x_min;
+        for (int x = x_min; x <= x_max; x++, i++)
+            planes.saturate(i, (glm::vec2(x + 0.5f, y + 0.5f) - water.pos) / water.radius);
+
+        wet.set_span(y, x_min, x_max);
+        saturated.set_span(y, x_min, x_max);
+    }
+}
+
+// Pixels whose centres fall inside the capsule swept by a disc of water moving from water.pos to `to`, in a single pass.
+// Each pixel gets the velocity of the last disc along the way to cover it, as if the disc had been rasterised at every point.
+template <typename Planes>
+void rasterise_sweep(Planes& planes, WetMask& wet, WetMask& saturated, const Water& water, const glm::vec2& to)
+{
+    const glm::vec2 from = water.pos;
+    const float r = water.radius, r2 = r * r;
+    const float length = glm::distance(from, to);
+    const glm::vec2 dir = (to - from) / length;
+
+    const int y_min = std::max((int)std::ceil(std::min(from.y, to.y) - r - 0.5f), 0);
+    const int y_max = std::min((int)std::floor(std::max(from.y, to.y) + r - 0.5f), planes.size.y - 1);
+    for (int y = y_min; y <= y_max; y++) {
+
+        // The capsule is convex, so its intersection with the row is the hull of those of its end discs and of the band between them
+        const float cy = y + 0.5f;
+        float lo = INFINITY, hi = -INFINITY;
+        for (const glm::vec2& end : { from, to }) {
+            const float dy = cy - end.y;
+            if (dy * dy <= r2) {
+                const float half_width = std::sqrt(r2 - dy * dy);
+                lo = std::min(lo, end.x - half_width);
+                hi = std::max(hi, end.x + half_width);
+            }
+        }
+
+        // Along the row, the distance from the segment's line and the projection onto it are linear in x
+        float band_lo = -INFINITY, band_hi = INFINITY;
+        const auto clip = [&](float slope, float offset, float min, float max) {
+            // min <= slope * x + offset <= max
+            if (std::abs(slope) < 1e-6f) {
+                if (offset < min || offset > max)
+                    band_lo = INFINITY;
+                return;
+            }
+            const float a = (min - offset) / slope, b = (max - offset) / slope;
+            band_lo = std::max(band_lo, std::min(a, b));
+            band_hi = std::min(band_hi, std::max(a, b));
+        };
+        clip(-dir.y, (cy - from.y) * dir.x + from.x * dir.y, -r, r);
+        clip(dir.x, (cy - from.y) * dir.y - from.x * dir.x, 0.0f, length);
+        if (band_lo <= band_hi) {
+            lo = std::min(lo, band_lo);
+            hi = std::max(hi, band_hi);
+        }
+
+        const int x_min = std::max((int)std::ceil(lo - 0.5f), 0);
+        const int x_max = std::min((int)std::floor(hi - 0.5f), planes.size.x - 1);
+        if (x_min > x_max)
+            continue;
+
+        size_t i = (size_t)planes.size.x * y + x_min;
+        for (int x = x_min; x <= x_max; x++, i++) {
+            // The last disc to cover the pixel is the furthest along the segment within its radius
+            const glm::vec2 d = glm::vec2(x + 0.5f, cy) - from;
+            const float along = glm::dot(d, dir), across = d.x * dir.y - d.y * dir.x;
+            const float last = std::clamp(along + std::sqrt(std::max(r2 - across * across, 0.0f)), 0.0f, length);
+            planes.saturate(i, (d - last * dir) / r);
+        }
+
+        wet.set_span(y, x_min, x_max);
+        saturated.set_span(y, x_min, x_max);
+    }
+}
+
+// Copy a run of values, a register at a time
+template <typename T>
+void copy_run(T* dst, const T* src, int n)
+{
+    char* d = (char*)dst;
+    const char* s = (const char*)src;
+    const size_t bytes = (size_t)n * sizeof(T);
+    size_t k = 0;
+#if defined(WATERCOLOUR_SIMD_AVX2)
+    for (; k + sizeof(__m256i) <= bytes; k += sizeof(__m256i))
+        _mm256_storeu_si256((__m256i*)(d + k), _mm256_loadu_si256((const __m256i*)(s + k)));
+#elif defined(WATERCOLOUR_SIMD_SSE2)
+    for (; k + sizeof(__m128i) <= bytes; k += sizeof(__m128i))
+        _mm_storeu_si128((__m128i*)(d + k), _mm_loadu_si128((const __m128i*)(s + k)));
+#endif
+    std::memcpy(d + k, s + k, bytes - k);
+}
+
+// Fill a run with a value, a register at a time
+template <typename T>
+void fill_run(T* dst, T value, int n)
+{
+    int k = 0;
+#if defined(WATERCOLOUR_SIMD_AVX2) || defined(WATERCOLOUR_SIMD_SSE2)
+    alignas(simd_alignment) T pattern[simd_alignment / sizeof(T)];
+    std::fill(std::begin(pattern), std::end(pattern), value);
+#endif
+#if defined(WATERCOLOUR_SIMD_AVX2)
+    const __m256i v = _mm256_load_si256((const __m256i*)pattern);
+    for (const int lanes = (int)(sizeof(__m256i) / sizeof(T)); k + lanes <= n; k += lanes)
+        _mm256_storeu_si256((__m256i*)(dst + k), v);
+#elif defined(WATERCOLOUR_SIMD_SSE2)
+    const __m128i v = _mm_load_si128((const __m128i*)pattern);
+    for (const int lanes = (int)(sizeof(__m128i) / sizeof(T)); k + lanes <= n; k += lanes)
+        _mm_storeu_si128((__m128i*)(dst + k), v);
+#endif
+    std::fill(dst + k, dst + n, value);
+}
+
+// Blend a footprint into the planes and masks, a run at a time.
+// The footprint is always saturated, so the max of its wetness with the planes' is a fill,
+// and its velocities replace the planes' as those of the last water to cover the pixels.
+template <typename Planes>
+void blit_footprint(Planes& planes, WetMask& wet, WetMask& saturated, const Footprint& footprint, const glm::ivec2& pixel)
+{
+    using V = typename Planes::Velocity;
+    const V* vx;
+    const V* vy;
+    if constexpr (std::is_floating_point_v<V>) {
+        vx = footprint.vx.data();
+        vy = footprint.vy.data();
+    } else {
+        vx = footprint.vx8.data();
+        vy = footprint.vy8.data();
+    }
+
+    for (const Footprint::Run& run : footprint.runs) {
+        const int y = pixel.y + run.y;
+        if (y < 0 || y >= planes.size.y)
+            continue;
+
+        const int x_min = std::max(pixel.x + run.x_min, 0), x_max = std::min(pixel.x + run.x_max, planes.size.x - 1);
+        if (x_min > x_max)
+            continue;
+
+        const size_t first = run.first + (size_t)(x_min - pixel.x - run.x_min);
+        const size_t i = (size_t)planes.size.x * y + x_min;
+        const int n = x_max - x_min + 1;
+        copy_run(&planes.vx[i], vx + first, n);
+        copy_run(&planes.vy[i], vy + first, n);
+        fill_run(&planes.w[i], Planes::saturated, n);
+
+        wet.set_span(y, x_min, x_max);
+        saturated.set_span(y, x_min, x_max);
+    }
+}
+
+// Write water to the tiles overlapping a box of pixels: bring them up to date, rasterise the water into the planes and masks
+// with rasterise(planes), then update their masks and decay bookkeeping
+template <typename F>
+void write_water(WetMap& map, const glm::vec2& min, const glm::vec2& max, F&& rasterise)
+{
+    const glm::ivec2 t_min = glm::max(glm::ivec2(glm::floor(min)), 0) >> WetMask::tile_shift;
+    const glm::ivec2 t_max = glm::min(glm::ivec2(glm::ceil(max)), map.size - 1) >> WetMask::tile_shift;
+    if (glm::any(glm::greaterThan(t_min, t_max)))
+        return;
+
+    std::visit([&](auto& p) {
+        // Bring the tiles up to date before writing to them
+        for (int ty = t_min.y; ty <= t_max.y; ty++)
+            for (int tx = t_min.x; tx <= t_max.x; tx++) {
+                WetTile& tile = map.tiles[ty * map.tile_count.x + tx];
+                if (tile.active && tile.last_update != map.tick)
+                    materialise_tile(p, map.wet, tile, tx, ty, map.tick);
+                tile.last_update = map.tick;
+            }
+
+        rasterise(p);
+
+        for (int ty = t_min.y; ty <= t_max.y; ty++)
+            for (int tx = t_min.x; tx <= t_max.x; tx++) {
+                const int t = ty * map.tile_count.x + tx;
+                WetTile& tile = map.tiles[t];
+                map.wet.update_tile(tx, ty);
+                map.saturated.update_tile(tx, ty);
+                if (map.saturated.tile_states[t] == WetMask::Empty)
+                    continue; // The water only covered the tile's bounding box
+
+                tile.min_wet = tile.active ? std::min(tile.min_wet, (float)p.saturated) : (float)p.saturated;
+                if (!tile.active)
+                    map.active_tiles.push_back(t);
+                tile.active = true;
+                tile.next_dry = next_dry(p, tile);
+                tile.display_dirty = true;
+                if (!tile.touched)
+                    map.touched_tiles.push_back(t);
+                tile.touched = true;
+            }
+    },
+        map.planes);
+
+    map.version++;
+}
+
+}
+
+WetMap::WetMap(const glm::ivec2& canvas_size, WetMapFormat storage)
+    : WetGrid { canvas_size }
+    , format(storage)
+    , planes(FloatWetPlanes(glm::ivec2(0, 0)))
+    , wet(canvas_size)
+    , saturated(canvas_size)
+    , tile_count(wet.tiles)
+    , tiles((size_t)tile_count.x * tile_count.y)
+{
+    switch (format) {
+    case WetMapFormat::Float:
+        planes.emplace<FloatWetPlanes>(canvas_size);
+        break;
+    case WetMapFormat::Compact8:
+        planes.emplace<Compact8WetPlanes>(canvas_size);
+        break;
+    case WetMapFormat::Compact16:
+        planes.emplace<Compact16WetPlanes>(canvas_size);
+        break;
+    }
+}
+
+int WetMap::bytes_per_pixel() const
+{
+    return visit([](const auto& p) { return (int)(2 * sizeof(p.vx[0]) + sizeof(p.w[0])); });
+}
+
+void WetMap::add_water(const Water& water)
+{
+    if (water.radius <= 0.0f)
+        return;
+
+    write_water(*this, water.pos - water.radius, water.pos + water.radius, [&](auto& p) { rasterise_water(p, wet, saturated, water); });
+}
+
+void WetMap::sweep_water(const Water& water, const glm::vec2& to)
+{
+    if (water.radius <= 0.0f)
+        return;
+
+    // Too short to have a direction
+    if (glm::distance(water.pos, to) < 1e-3f) {
+        add_water({ to, water.radius });
+        return;
+    }
+
+    write_water(*this, glm::min(water.pos, to) - water.radius, glm::max(water.pos, to) + water.radius, [&](auto& p) { rasterise_sweep(p, wet, saturated, water, to); });
+}
+
+void WetMap::add_footprint(const Footprint& footprint, const glm::ivec2& pixel)
+{
+    if (footprint.runs.empty())
+        return;
+
+    write_water(*this, glm::vec2(pixel + footprint.min), glm::vec2(pixel + footprint.max), [&](auto& p) { blit_footprint(p, wet, saturated, footprint, pixel); });
+}
+
+bool Footprint::matches(const std::vector<Water>& discs, const glm::vec2& pixel_phase) const
+{
+    return pixel_phase == phase && discs.size() == water.size()
+        && std::equal(discs.begin(), discs.end(), water.begin(), [](const Water& a, const Water& b) { return a.pos == b.pos && a.radius == b.radius; });
+}
+
+void Footprint::build(const std::vector<Water>& discs, const glm::vec2& pixel_phase)
+{
+    water = discs;
+    phase = pixel_phase;
+    runs.clear();
+    vx.clear();
+    vy.clear();
+    vx8.clear();
+    vy8.clear();
+    min = glm::ivec2(0, 0);
+    max = glm::ivec2(-1, -1);
+
+    // Pixels whose centres may fall inside a disc, as rasterise_water bounds them
+    glm::ivec2 box_min(INT_MAX, INT_MAX), box_max(INT_MIN, INT_MIN);
+    for (const Water& w : water) {
+        if (w.radius <= 0.0f)
+            continue;
+        const glm::vec2 centre = phase + w.pos;
+        box_min = glm::min(box_min, glm::ivec2(glm::ceil(centre - w.radius - 0.5f)));
+        box_max = glm::max(box_max, glm::ivec2(glm::floor(centre + w.radius - 0.5f)));
+    }
+    if (glm::any(glm::greaterThan(box_min, box_max)))
+        return;
+
+    // Each row is rasterised disc by disc, then its covered pixels are gathered into runs
+    const int width = box_max.x - box_min.x + 1;
+    std::vector<glm::vec2> row((size_t)width);
+    std::vector<char> covered((size_t)width);
+    min = box_max;
+    max = box_min;
+    for (int y = box_min.y; y <= box_max.y; y++) {
+        std::fill(covered.begin(), covered.end(), 0);
+        for (const Water& w : water) {
+            if (w.radius <= 0.0f)
+                continue;
+            const glm::vec2 centre = phase + w.pos;
+            if (y < (int)std::ceil(centre.y - w.radius - 0.5f) || y > (int)std::floor(centre.y + w.radius - 0.5f))
+                continue;
+
+            const float dy = y + 0.5f - centre.y;
+            const float half_width = std::sqrt(std::max(w.radius * w.radius - dy * dy, 0.0f));
+            const int x_min = (int)std::ceil(centre.x - half_width - 0.5f);
+            const int x_max = (int)std::floor(centre.x + half_width - 0.5f);
+            for (int x = x_min; x <= x_max; x++) {
+                row[x - box_min.x] = (glm::vec2(x + 0.5f, y + 0.5f) - centre) / w.radius;
+                covered[x - box_min.x] = 1;
+            }
+        }
+
+        for (int x = 0; x < width; x++) {
+            if (!covered[x])
+                continue;
+
+            Run run { y, box_min.x + x, 0, (uint32_t)vx.size() };
+            for (; x < width && covered[x]; x++) {
+                vx.push_back(row[x].x);
+                vy.push_back(row[x].y);
+                vx8.push_back(Compact8WetPlanes::store_velocity(row[x].x));
+                vy8.push_back(Compact8WetPlanes::store_velocity(row[x].y));
+            }
+            run.x_max = box_min.x + x - 1;
+            runs.push_back(run);
+            min = glm::min(min, glm::ivec2(run.x_min, y));
+            max = glm::max(max, glm::ivec2(run.x_max, y));
+        }
+    }
+}
+
+void WetMap::dry_tiles()
+{
+    tick++;
+
+    // Only the tiles in which a pixel dries this tick need their stored wetness and wet bits updating
+    std::visit([&](auto& p) {
+        for (size_t i = 0; i < active_tiles.size();) {
+            const int t = active_tiles[i];
+            WetTile& tile = tiles[t];
+            if (tile.next_dry <= tick) {
+                materialise_tile(p, wet, tile, t % tile_count.x, t / tile_count.x, tick);
+                tile.next_dry = next_dry(p, tile);
+                tile.display_dirty = true;
+                if (!tile.active) {
+                    active_tiles[i] = active_tiles.back();
+                    active_tiles.pop_back();
+                    continue;
+                }
+            }
+            i++;
+        }
+    },
+        planes);
+
+    version++;
+}
+
+void WetMap::desaturate()
+{
+    // Nothing stays saturated after decaying
+    for (int t : touched_tiles) {
+        saturated.clear_tile(t % tile_count.x, t / tile_count.x);
+        tiles[t].touched = false;
+    }
+    touched_tiles.clear();
+}
+
+void WetMap::export_tile_rgba8(int t, unsigned char* out) const
+{
+    const int tx = t % tile_count.x, ty = t / tile_count.x;
+    const int x_min = tx * WetMask::tile_size, x_max = std::min(x_min + WetMask::tile_size, size.x);
+    const int y_min = ty * WetMask::tile_size, y_max = std::min(y_min + WetMask::tile_size, size.y);
+
+    visit([&](const auto& p) {
+        // Wetness is decayed on read
+        const float elapsed = (float)(tick - tiles[t].last_update) * p.decay_step + p.epsilon;
+        for (int y = y_min; y < y_max; y++)
+            for (size_t i = (size_t)size.x * y + x_min; i < (size_t)size.x * y + x_max; i++, out += 4) {
+                const glm::vec2 vel = p.velocity(i);
+                out[0] = (unsigned char)std::round(127.5f * (vel.x + 1.0f));
+                out[1] = (unsigned char)std::round(127.5f * (vel.y + 1.0f));
+                out[2] = 0;
+                out[3] = (unsigned char)std::round(255.0f * std::max((float)p.w[i] - elapsed + p.epsilon, 0.0f) / p.saturated);
+            }
+    });
+}
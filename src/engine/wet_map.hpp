@@ -0,0 +1,218 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "wet_mask.hpp"
+
+// Wetness lost by every pixel of the wet map each tick
+const float wetness_decay = 0.005f;
+
+// A disc of water to be added to the wet map
+struct Water {
+    glm::vec2 pos;
+    float radius;
+};
+
+// Storage formats of the wet map, selected when a canvas is created
+enum class WetMapFormat {
+    Float, // 32-bit float velocity and wetness, 12 bytes per pixel
+    Compact8, // 8-bit velocity and wetness, 3 bytes per pixel
+    Compact16 // 8-bit velocity and 16-bit wetness, 4 bytes per pixel
+};
+
+// Pixel grid shared by the wet map and its planes, bottom row first
+struct WetGrid {
+
+    glm::ivec2 size;
+
+    // Return the index of the pixel containing a point
+    size_t index(const glm::vec2& point) const
+    {
+        return (size_t)size.x * (int)point.y + (int)point.x;
+    }
+
+    // Clamp a point to the grid
+    glm::vec2 clamp_point(const glm::vec2& point) const
+    {
+        return glm::clamp(point, glm::vec2(0.0f, 0.0f), glm::vec2(size.x - 0.001f, size.y - 0.001f));
+    }
+
+    // Return true iff a point is inside the grid
+    bool contains_point(const glm::vec2& point) const
+    {
+        return point.x >= 0 && point.x <= size.x && point.y >= 0 && point.y <= size.y;
+    }
+};
+
+// The wet map stored as separate planes for the two velocity components and the wetness.
+// Integer types hold values quantised to their full range: velocity in [-1, 1], wetness in [0, 1].
+template <typename V, typename W>
+struct WetPlanes : WetGrid {
+
+    using Velocity = V;
+    using Wetness = W;
+
+    static constexpr W saturated = std::is_floating_point_v<W> ? W(1) : std::numeric_limits<W>::max();
+    static constexpr float velocity_scale = std::is_floating_point_v<V> ? 1.0f : std::numeric_limits<V>::max();
+
+    std::vector<V> vx, vy;
+    std::vector<W> w;
+    W decay_step; // Wetness lost per tick, at least one quantisation step
+    static constexpr float epsilon = std::is_floating_point_v<W> ? 1e-5f : 0.0f; // Rounding error allowed when decaying several ticks at once
+
+    WetPlanes(const glm::ivec2& canvas_size)
+        : WetGrid { canvas_size }
+        , vx((size_t)canvas_size.x * canvas_size.y, V(0))
+        , vy((size_t)canvas_size.x * canvas_size.y, V(0))
+        , w((size_t)canvas_size.x * canvas_size.y, W(0))
+        , decay_step(std::is_floating_point_v<W> ? W(wetness_decay) : std::max(W(wetness_decay * saturated + 0.5f), W(1)))
+    {
+    }
+
+    glm::vec2 velocity(size_t i) const
+    {
+        return glm::vec2(vx[i], vy[i]) / velocity_scale;
+    }
+
+    float wetness(size_t i) const
+    {
+        return (float)w[i] / saturated;
+    }
+
+    // Return a velocity component as stored in the planes
+    static V store_velocity(float v)
+    {
+        if constexpr (std::is_floating_point_v<V>)
+            return v;
+        else
+            return (V)std::round(glm::clamp(v, -1.0f, 1.0f) * velocity_scale);
+    }
+
+    // Saturate a pixel with water flowing with the given velocity
+    void saturate(size_t i, const glm::vec2& vel)
+    {
+        vx[i] = store_velocity(vel.x);
+        vy[i] = store_velocity(vel.y);
+        w[i] = saturated;
+    }
+};
+
+using FloatWetPlanes = WetPlanes<float, float>;
+using Compact8WetPlanes = WetPlanes<int8_t, uint8_t>;
+using Compact16WetPlanes = WetPlanes<int8_t, uint16_t>;
+
+// The water of a stamp rasterised once, relative to the pixel the stamp is placed in, so that it can be copied into the wet map
+// wherever the stamp lands at the same position within its pixel. Placing it gives the same pixels and velocities as add_water
+// with each of its discs in turn, up to float rounding.
+struct Footprint {
+
+    // A run of covered pixels in a row, relative to the stamp's pixel
+    struct Run {
+        int y, x_min, x_max;
+        uint32_t first; // Index of the velocity of its first pixel
+    };
+
+    // What it was rasterised from: the discs relative to the stamp's position, and the position within its pixel
+    std::vector<Water> water;
+    glm::vec2 phase = glm::vec2(0.0f, 0.0f);
+
+    std::vector<Run> runs;
+    std::vector<float> vx, vy; // Velocity of each covered pixel, run by run
+    std::vector<int8_t> vx8, vy8; // The same, as stored by the compact formats
+    glm::ivec2 min = glm::ivec2(0, 0), max = glm::ivec2(-1, -1); // Bounding box of the runs
+
+    // Return true iff it was rasterised from these discs at this position within a pixel
+    bool matches(const std::vector<Water>& discs, const glm::vec2& pixel_phase) const;
+
+    // Rasterise discs of water relative to a stamp at a position within pixel (0, 0),
+    // later discs overwriting the velocity of earlier ones as add_water would
+    void build(const std::vector<Water>& discs, const glm::vec2& pixel_phase);
+};
+
+// Decay bookkeeping for a tile of the wet map, the same tiles as used by the masks.
+// The stored wetness of a tile is only decayed when it is written to or when one of its pixels dries,
+// in between it is decayed on read by the ticks elapsed since last_update.
+struct WetTile {
+    int last_update = 0; // Tick up to which the stored wetness has been decayed
+    int next_dry = 0; // Tick at which the next of its wet pixels dries
+    float min_wet = 0.0f; // Lowest non-zero stored wetness, in units of the planes
+    bool active = false; // Any of its pixels is wet
+    bool touched = false; // Water was added since the last tick
+    bool display_dirty = true; // Changed since it was last exported for display
+};
+
+// The wet map, holding the velocity and wetness of the water on the canvas.
+// This is the authoritative copy, it is only uploaded to the GPU to be displayed.
+// The wet and saturated masks mirror the wetness plane for the tests done by the splats.
+// Decay is lazy and per tile, so only tiles with water in them cost anything per tick.
+struct WetMap : WetGrid {
+
+    WetMapFormat format;
+    std::variant<FloatWetPlanes, Compact8WetPlanes, Compact16WetPlanes> planes; // Alternatives in the order of WetMapFormat
+    WetMask wet; // Wetness > 0
+    WetMask saturated; // Wetness == 1
+    glm::ivec2 tile_count;
+    std::vector<WetTile> tiles;
+    std::vector<int> active_tiles, touched_tiles;
+    int tick = 0; // Number of ticks decayed
+    int version = 0; // Incremented on every change
+
+    WetMap(const glm::ivec2& canvas_size, WetMapFormat storage = WetMapFormat::Float);
+
+    // Call f with the planes of the wet map, statically typed by format
+    template <typename F>
+    decltype(auto) visit(F&& f) const
+    {
+        return std::visit(f, planes);
+    }
+
+    // Number of bytes used per pixel
+    int bytes_per_pixel() const;
+
+    // Saturate the pixels covered by a disc of water, with the velocity pointing outwards from its centre
+    void add_water(const Water& water);
+
+    // Saturate the pixels swept by a disc of water moving in a straight line from its position to another in one pass,
+    // with the velocity of the last position of the disc to cover each pixel, as add_water at every point along the way would
+    void sweep_water(const Water& water, const glm::vec2& to);
+
+    // Saturate the pixels covered by a footprint, placed with its pixel (0, 0) at the given pixel
+    void add_footprint(const Footprint& footprint, const glm::ivec2& pixel);
+
+    // Advance to the next tick, reducing the wetness of every pixel
+    void decay()
+    {
+        dry_tiles();
+        desaturate();
+    }
+
+    // The two halves of decay, which touch separate state: move on to the next tick, updating the tiles in which a pixel dries,
+    // and clear the pixels saturated during the tick
+    void dry_tiles();
+    void desaturate();
+
+    // Pass each tile which changed since the last export to upload as 8-bit RGBA for display,
+    // with the velocity in R/G mapped to [0, 1] and the wetness in A
+    template <typename F>
+    void export_rgba8(F&& upload)
+    {
+        unsigned char pixels[4 * WetMask::tile_size * WetMask::tile_size];
+        for (int t = 0; t < (int)tiles.size(); t++)
+            if (tiles[t].display_dirty || tiles[t].active) {
+                const glm::ivec2 min = WetMask::tile_size * glm::ivec2(t % tile_count.x, t / tile_count.x);
+                const glm::ivec2 tile_size = glm::min(min + WetMask::tile_size, size) - min;
+                export_tile_rgba8(t, pixels);
+                upload(min, tile_size, pixels);
+                tiles[t].display_dirty = false;
+            }
+    }
+
+    // Write a tile as 8-bit RGBA, rows packed tightly
+    void export_tile_rgba8(int t, unsigned char* out) const;
+};
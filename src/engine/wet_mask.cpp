@@ -0,0 +1,111 @@
+#include "wet_mask.hpp"
+
+#include <algorithm>
+
+WetMask::WetMask(const glm::ivec2& canvas_size)
+    : size(canvas_size)
+    , tiles((canvas_size + tile_size - 1) / tile_size)
+    , words_per_row(tiles.x)
+    , bits((size_t)words_per_row * canvas_size.y, 0)
+    , tile_states((size_t)tiles.x * tiles.y, Empty)
+{
+}
+
+bool WetMask::any(const glm::ivec2& min, const glm::ivec2& max) const
+{
+    if (empty())
+        return false;
+
+    const glm::ivec2 t_min = glm::max(min, 0) >> tile_shift;
+    const glm::ivec2 t_max = glm::min(max, size - 1) >> tile_shift;
+    for (int ty = t_min.y; ty <= t_max.y; ty++)
+        for (int tx = t_min.x; tx <= t_max.x; tx++)
+            if (tile_states[ty * tiles.x + tx] != Empty)
+                return true;
+    return false;
+}
+
+bool WetMask::any_pixels(const glm::ivec2& min, const glm::ivec2& max) const
+{
+    if (empty())
+        return false;
+
+    const glm::ivec2 p_min = glm::max(min, 0), p_max = glm::min(max, size - 1);
+    const glm::ivec2 t_min = p_min >> tile_shift, t_max = p_max >> tile_shift;
+    for (int ty = t_min.y; ty <= t_max.y; ty++)
+        for (int tx = t_min.x; tx <= t_max.x; tx++) {
+            const TileState state = tile_states[ty * tiles.x + tx];
+            if (state != Mixed) {
+                if (state == Full)
+                    return true;
+                continue;
+            }
+
+            // The part of the box inside this tile
+            const int x_lo = std::max(p_min.x - tx * tile_size, 0), x_hi = std::min(p_max.x - tx * tile_size, tile_size - 1);
+            const int y_lo = std::max(p_min.y, ty * tile_size), y_hi = std::min(p_max.y, (ty + 1) * tile_size - 1);
+            const uint64_t mask = (x_hi == tile_size - 1 ? ~uint64_t(0) : (uint64_t(1) << (x_hi + 1)) - 1) & ~((uint64_t(1) << x_lo) - 1);
+            for (int y = y_lo; y <= y_hi; y++)
+                if (bits[(size_t)y * words_per_row + tx] & mask)
+                    return true;
+        }
+    return false;
+}
+
+void WetMask::set_span(int y, int x_min, int x_max)
+{
+    uint64_t* row = &bits[(size_t)y * words_per_row];
+    const int first = x_min >> tile_shift, last = x_max >> tile_shift;
+    for (int word = first; word <= last; word++) {
+        const int lo = word == first ? x_min & (tile_size - 1) : 0;
+        const int hi = word == last ? x_max & (tile_size - 1) : tile_size - 1;
+        row[word] |= (hi == tile_size - 1 ? ~uint64_t(0) : (uint64_t(1) << (hi + 1)) - 1) & ~((uint64_t(1) << lo) - 1);
+    }
+}
+
+void WetMask::clear()
+{
+    if (empty())
+        return;
+
+    std::fill(bits.begin(), bits.end(), 0);
+    std::fill(tile_states.begin(), tile_states.end(), Empty);
+    non_empty_tiles = 0;
+}
+
+void WetMask::clear_tile(int tx, int ty)
+{
+    const int y_max = std::min((ty + 1) * tile_size, size.y);
+    for (int y = ty * tile_size; y < y_max; y++)
+        bits[(size_t)y * words_per_row + tx] = 0;
+
+    TileState& state = tile_states[ty * tiles.x + tx];
+    non_empty_tiles -= state != Empty;
+    state = Empty;
+}
+
+void WetMask::update_tile(int tx, int ty)
+{
+    const uint64_t valid = valid_bits(tx);
+    const int y_max = std::min((ty + 1) * tile_size, size.y);
+    bool any = false, all = true;
+    for (int y = ty * tile_size; y < y_max; y++) {
+        const uint64_t word = bits[(size_t)y * words_per_row + tx] & valid;
+        any |= word != 0;
+        all &= word == valid;
+    }
+
+    TileState& state = tile_states[ty * tiles.x + tx];
+    non_empty_tiles -= state != Empty;
+    state = all ? Full : any ? Mixed : Empty;
+    non_empty_tiles += state != Empty;
+}
+
+void WetMask::update_tiles(const glm::ivec2& min, const glm::ivec2& max)
+{
+    const glm::ivec2 t_min = glm::max(min, 0) >> tile_shift;
+    const glm::ivec2 t_max = glm::min(max, size - 1) >> tile_shift;
+    for (int ty = t_min.y; ty <= t_max.y; ty++)
+        for (int tx = t_min.x; tx <= t_max.x; tx++)
+            update_tile(tx, ty);
+}
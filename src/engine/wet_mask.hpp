@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// One bit per pixel of the wet map, bottom row first, with a summary of each 64x64 pixel tile.
+// A tile row is a single word, so the whole mask of a 4000x4000 canvas takes 2 MB.
+struct WetMask {
+
+    static constexpr int tile_shift = 6;
+    static constexpr int tile_size = 1 << tile_shift;
+
+    enum TileState : uint8_t {
+        Empty, // No bits set
+        Mixed,
+        Full // All bits inside the canvas set
+    };
+
+    glm::ivec2 size, tiles;
+    int words_per_row;
+    std::vector<uint64_t> bits;
+    std::vector<TileState> tile_states;
+    int non_empty_tiles = 0;
+
+    WetMask(const glm::ivec2& canvas_size);
+
+    // Return the bit of a pixel, looking at the bits themselves only if its tile is mixed
+    bool test(int x, int y) const
+    {
+        const TileState state = tile_states[(y >> tile_shift) * tiles.x + (x >> tile_shift)];
+        if (state != Mixed)
+            return state == Full;
+        return bits[(size_t)y * words_per_row + (x >> tile_shift)] >> (x & (tile_size - 1)) & 1;
+    }
+
+    bool test(const glm::vec2& point) const
+    {
+        return test((int)point.x, (int)point.y);
+    }
+
+    // Return true iff no bits are set at all
+    bool empty() const
+    {
+        return non_empty_tiles == 0;
+    }
+
+    // Return true iff any bit is set in the tiles overlapping a box of pixels
+    bool any(const glm::ivec2& min, const glm::ivec2& max) const;
+
+    // Return true iff any bit is set in a box of pixels, looking at the bits only in mixed tiles
+    bool any_pixels(const glm::ivec2& min, const glm::ivec2& max) const;
+
+    // Set the bits of the pixels [x_min, x_max] of a row, without updating the tile states
+    void set_span(int y, int x_min, int x_max);
+
+    // Set a word of bits of a row, without updating the tile states
+    void set_word(int y, int word, uint64_t value)
+    {
+        bits[(size_t)y * words_per_row + word] = value;
+    }
+
+    // Clear all bits
+    void clear();
+
+    // Clear the bits of a tile and update its state
+    void clear_tile(int tx, int ty);
+
+    // Recompute the state of a tile from its bits
+    void update_tile(int tx, int ty);
+
+    // Recompute the states of the tiles overlapping a box of pixels
+    void update_tiles(const glm::ivec2& min, const glm::ivec2& max);
+
+    // Mask of the bits of a word which lie inside the canvas
+    uint64_t valid_bits(int word) const
+    {
+        const int n = size.x - word * tile_size;
+        return n >= tile_size ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+    }
+};
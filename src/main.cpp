@@ -1,3 +1,6 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <framework/window.h>
 #include <glm/ext/matrix_clip_space.hpp>
@@ -7,9 +10,11 @@
 #include <stb/stb_image.h>
 #include <stb/stb_image_write.h>
 
+#include "engine/simulation.hpp"
+#include "engine/unit_circle.hpp"
+
 #include "canvas.hpp"
-#include "splat.hpp"
-#include "stamp.hpp"
+#include "menu.hpp"
 #include "style.hpp"
 
 const glm::ivec2 workspace_offset { 300, 0 };
@@ -22,8 +27,76 @@ enum class DebugMode {
     Wetness
 };
 
-int main()
+// Parts of a frame timed for the debug panel and the trace
+enum FramePhase {
+    UploadWetMap,
+    CompositeDried,
+    DrawSplats,
+    Gui
+};
+
+const std::array frame_phase_names = { "Upload wet map", "Composite dried", "Draw splats", "GUI" };
+
+// Replay a journal as fast as possible without opening a window and write the final canvas, return the exit code
+int replay_journal(const char* path, int threads, const char* output)
+{
+    Journal journal;
+    if (!journal.load(path)) {
+        std::fprintf(stderr, "Could not read the journal %s\n", path);
+        return 1;
+    }
+
+    ReplayStats stats;
+    const Image image = replay(journal, threads, stats);
+    std::printf("Replayed %llu actions over %llu ticks in %.3f s (%.1f ticks/s)\n", (unsigned long long)stats.actions, (unsigned long long)stats.ticks, stats.seconds, stats.seconds > 0.0 ? stats.ticks / stats.seconds : 0.0);
+
+    // The image's rows are stored bottom first
+    stbi_flip_vertically_on_write(1);
+    if (!stbi_write_png(output, image.size.x, image.size.y, 3, image.pixels.data(), 3 * image.size.x)) {
+        std::fprintf(stderr, "Could not write %s\n", output);
+        return 1;
+    }
+
+    // The canvas is still written, as it shows how far the replay got
+    if (stats.truncated) {
+        std::fprintf(stderr, "The journal is corrupt after %llu actions, the rest was not replayed\n", (unsigned long long)stats.actions);
+        return 1;
+    }
+    if (stats.diverged_marks > 0) {
+        std::fprintf(stderr, "The replay diverged from the recorded session at %llu of %llu marks, first at tick %u\n", (unsigned long long)stats.diverged_marks, (unsigned long long)stats.marks, stats.diverged_tick);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
 {
+    const char* replay_path = nullptr;
+    const char* output = nullptr;
+    int threads = -1;
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--replay") && has_value)
+            replay_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--threads") && has_value)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--output") && has_value)
+            output = argv[++i];
+        else
+            valid = false;
+    }
+    if (!valid || (!replay_path && (threads >= 0 || output))) {
+        std::fprintf(stderr,
+            "Usage: Watercolour [--replay JOURNAL [--threads N] [--output PNG]]\n"
+            "  --replay JOURNAL   Replay a journal without opening a window and write the final canvas\n"
+            "  --threads N        Replay with N threads, 0 for all cores, instead of as recorded\n"
+            "  --output PNG       Where to write the canvas, replay.png by default\n");
+        return 1;
+    }
+    if (replay_path)
+        return replay_journal(replay_path, threads, output ? output : "replay.png");
+
     glm::ivec2 win_size { 1300, 1000 };
     glm::ivec2 workspace_size { win_size.x - 300, win_size.y }; // The area where the canvas sits (leaving the GUI out)
     Window window { "Watercolour Painting", win_size, OpenGLVersion::GL2, true };
@@ -31,11 +104,10 @@ int main()
     const glm::ivec2 canvas_size { 900, 600 };
     const glm::ivec2 canvas_pos { (workspace_size - canvas_size) / 2 + workspace_offset };
     Canvas canvas { canvas_pos, canvas_size };
-    auto wet_map_data = new float[4 * canvas.size.x * canvas.size.y];
     int zoom_idx = 3;
 
     const char* stamp_names_separated_by_zeros = "Simple/Crunchy\0Wet-on-Dry\0Wet-on-Wet\0Blobby";
-    std::vector<Stamp*> stamps = { new Crunchy, new WetOnDry, new WetOnWet, new Blobby };
+    std::array<BuiltinStamp, 4> stamps = { Crunchy {}, WetOnDry {}, WetOnWet {}, Blobby {} };
     int stamp_idx = 0;
 
     glm::vec3 brush_color = { 1.0f, 0.0f, 0.0f };
@@ -44,11 +116,6 @@ int main()
     float flow = 1.0f;
     int vertices = 25;
     int stamp_spacing = 5.0f;
-    int lifetime = 60;
-
-    float gravity = 0.0f;
-    float unfixing_strength = 1.0f;
-    int drying_time = 600;
 
     bool ctrl = false;
     bool debug = false;
@@ -63,16 +130,25 @@ int main()
     bool stroke = false;
     bool wetting = false;
     bool pan = false;
-    int stroke_id = 0;
-
-    std::list<Splat> live_splats = {};
-    std::deque<Splat> undone_splats = {};
 
     int tps = 60;
     int saved_tps = tps;
-    float time_accum = 0.0f;
-    int resample_period = 10;
-    int resample_counter = 0;
+    bool degrade = true;
+    Settings settings;
+
+    Simulation simulation { canvas_size, glm::vec3(0.9f, 0.9f, 0.9f) };
+
+    // The latest snapshot of the simulation, and the generation of the canvas being drawn, older snapshots are ignored
+    const Snapshot* snapshot = nullptr;
+    uint32_t generation = 0;
+    auto frame_start = std::chrono::steady_clock::now();
+    float frame_time = 0.0f;
+
+    // Profiling of the render thread, the trace also collects the events the simulation sends along with its snapshots
+    std::array<History, frame_phase_names.size()> frame_history;
+    History frame_time_history;
+    Trace trace;
+    bool tracing = false;
 
     glEnable(GL_BLEND);
     glStencilFunc(GL_EQUAL, 1, 1);
@@ -82,8 +158,7 @@ int main()
     GLuint bg_fbo, bg;
     glGenFramebuffers(1, &bg_fbo);
 
-    GLuint wet_map_fbo, wet_map;
-    glGenFramebuffers(1, &wet_map_fbo);
+    GLuint wet_map;
 
     const auto generate_canvas = [&](const glm::vec3& bg_color) {
         // Canvas texture
@@ -109,37 +184,31 @@ int main()
         glClearColor(bg_color.r, bg_color.g, bg_color.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        // Wet map
-        glBindFramebuffer(GL_FRAMEBUFFER, wet_map_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+        // Wet map texture, only used for display (the engine keeps the wet map itself)
         glGenTextures(1, &wet_map);
         glBindTexture(GL_TEXTURE_2D, wet_map);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, canvas.size.x, canvas.size.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, canvas.size.x, canvas.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, wet_map, 0);
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glClearColor(0.27f, 0.27f, 0.27f, 1.0f);
     };
 
     generate_canvas(glm::vec3(0.9f, 0.9f, 0.9f));
 
     // Actions
-    const auto new_canvas = [&](const glm::ivec2& new_size, const glm::vec3& bg_color) {
-        live_splats.clear();
-        undone_splats.clear();
+    const auto new_canvas = [&](const glm::ivec2& new_size, const glm::vec3& bg_color, WetMapFormat format) {
+        simulation.reset(new_size, format, bg_color);
+        snapshot = nullptr;
+        generation++;
         zoom_idx = 3;
 
         canvas = Canvas((workspace_size - new_size) / 2 + workspace_offset, new_size);
         generate_canvas(bg_color);
-
-        delete[] wet_map_data;
-        wet_map_data = new float[4 * canvas.size.x * canvas.size.y];
     };
 
     const auto open_canvas = [&]() {
@@ -160,7 +229,7 @@ int main()
                     for (int j = 0; j < width * 3; j++)
                         std::swap(data[i * width * 3 + j], data[(height - i - 1) * width * 3 + j]);
 
-                new_canvas(glm::ivec2(width, height), glm::vec3(0.0f));
+                new_canvas(glm::ivec2(width, height), glm::vec3(0.0f), snapshot ? snapshot->wet_map_format : WetMapFormat::Float);
                 glBindTexture(GL_TEXTURE_2D, bg);
                 glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
                 stbi_image_free(data);
@@ -189,24 +258,39 @@ int main()
         free(p_out_path);
     };
 
-    const auto undo = [&]() {
-        if (live_splats.size() > 0) {
-            const int last_stroke_id = live_splats.back().stroke_id;
-            while (live_splats.size() > 0 && live_splats.back().stroke_id == last_stroke_id) {
-                undone_splats.push_back(live_splats.back());
-                live_splats.pop_back();
-            }
+    const auto export_trace = [&]() {
+        nfdchar_t* p_out_path = nullptr;
+        nfdresult_t result = NFD_SaveDialog("json;csv", nullptr, &p_out_path);
+        if (result == NFD_OKAY) {
+            const std::filesystem::path out_path { p_out_path };
+            if (out_path.extension() == ".csv")
+                trace.write_csv(out_path.string());
+            else
+                trace.write_chrome_json(out_path.string());
         }
+        free(p_out_path);
     };
 
-    const auto redo = [&]() {
-        if (undone_splats.size() > 0) {
-            const int last_stroke_id = undone_splats.back().stroke_id;
-            while (undone_splats.size() > 0 && undone_splats.back().stroke_id == last_stroke_id) {
-                live_splats.push_back(undone_splats.back());
-                undone_splats.pop_back();
-            }
+    // Plot a history as a histogram filling the width available, its label hidden
+    const auto plot_history = [](const char* label, const History& history, float height) {
+        ImGui::PushID(label);
+        ImGui::PlotHistogram("", history.samples.data(), (int)history.samples.size(), (int)history.next, nullptr, 0.0f, history.max(), ImVec2(-1.0f, height));
+        ImGui::PopID();
+    };
+
+    const auto save_journal = [&]() {
+        nfdchar_t* p_out_path = nullptr;
+        nfdresult_t result = NFD_SaveDialog("wcj", nullptr, &p_out_path);
+        if (result == NFD_OKAY) {
+            std::filesystem::path out_path { p_out_path };
+            out_path.replace_extension(".wcj");
+            simulation.save_journal(out_path.string());
         }
+        free(p_out_path);
+    };
+
+    const auto brush = [&]() {
+        return Brush { brush_color, (float)brush_size, roughness, flow, settings.lifetime, vertices };
     };
 
     const auto zoom = [&](const bool zoom_in, const glm::vec2& center) {
@@ -248,17 +332,16 @@ int main()
                 show_save_canvas_window = true;
             else
                 // Press S to force boundary resampling
-                for (auto& splat : live_splats)
-                    splat.resample();
+                simulation.perform(action::Resample {});
         }
 
         // Ctrl+Z: Undo
         if (key == GLFW_KEY_Z && ctrl && action == GLFW_PRESS)
-            undo();
+            simulation.perform(action::Undo {});
 
         // Ctrl+Y: Redo
         if (key == GLFW_KEY_Y && ctrl && action == GLFW_PRESS)
-            redo();
+            simulation.perform(action::Redo {});
 
         // Pause
         if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
@@ -276,25 +359,13 @@ int main()
                 stroke = true;
                 wetting = false;
 
-                // Place the first stamp
+                // Place the first stamp and update the wet map
                 last_stamp = canvas.canvas_coords(cursor_pos);
-                if (canvas.contains_canvas_point(last_stamp))
-                    stamps[stamp_idx]->place(&live_splats, canvas, last_stamp, brush_color, brush_size, roughness, flow, stroke_id, lifetime, vertices);
-                undone_splats.clear();
-
-                // Bind wet map
-                glBindFramebuffer(GL_FRAMEBUFFER, wet_map_fbo);
-                glViewport(0, 0, canvas.size.x, canvas.size.y);
-
-                // Update wet map
-                stamps[stamp_idx]->wet_canvas(canvas, last_stamp, vertices, brush_size);
-
-                // Unbind wet map
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                simulation.perform(action::BeginStroke { (uint8_t)stamp_idx, last_stamp, brush() });
 
             } else if (action == GLFW_RELEASE) {
                 stroke = false;
-                stroke_id++;
+                simulation.perform(action::EndStroke {});
             }
         }
 
@@ -306,15 +377,8 @@ int main()
 
                 last_stamp = canvas.canvas_coords(cursor_pos);
 
-                // Bind wet map
-                glBindFramebuffer(GL_FRAMEBUFFER, wet_map_fbo);
-                glViewport(0, 0, canvas.size.x, canvas.size.y);
-
                 // Update wet map
-                add_water(canvas, last_stamp, vertices, brush_size);
-
-                // Unbind wet map
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                simulation.perform(action::AddWater { last_stamp, (float)brush_size });
             } else if (action == GLFW_RELEASE) {
                 wetting = false;
             }
@@ -338,33 +402,15 @@ int main()
             // Iterate along the stroke, updating the wet map and placing stamps
             if (dist >= stamp_spacing) {
 
-                // Bind wet map
-                glBindFramebuffer(GL_FRAMEBUFFER, wet_map_fbo);
-                glViewport(0, 0, canvas.size.x, canvas.size.y);
-
                 const glm::vec2 dir = glm::normalize(glm::vec2(cur_pos - last_stamp));
-                glm::vec2 pos = last_stamp;
-
-                for (float i = 1.0f; i <= dist; i += 1.0f) {
-
-                    pos += dir;
-
-                    // Update wet map
-                    if (wetting)
-                        add_water(canvas, pos, vertices, brush_size);
-                    else
-                        stamps[stamp_idx]->wet_canvas(canvas, pos, vertices, brush_size);
-
-                    // Place stamp
-                    if (std::fmod(i, stamp_spacing) == 0.0f) {
-                        last_stamp = pos;
-                        if (stroke && canvas.contains_canvas_point(last_stamp))
-                            stamps[stamp_idx]->place(&live_splats, canvas, last_stamp, brush_color, brush_size, roughness, flow, stroke_id, lifetime, vertices);
-                    }
-                }
-
-                // Unbind wet map
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                const glm::vec2 start = last_stamp;
+                const int steps = (int)dist;
+
+                if (wetting)
+                    simulation.perform(action::SweepWater { start + dir, start + (float)steps * dir, (float)brush_size });
+                else
+                    simulation.perform(action::PaintSegment { (uint8_t)stamp_idx, start, dir, steps, stamp_spacing, brush() });
+                last_stamp = start + (float)(steps / stamp_spacing * stamp_spacing) * dir;
             }
         }
 
@@ -394,66 +440,122 @@ int main()
     // ImGui setup
     darkStyle();
 
-    auto t = std::chrono::system_clock::now();
-    float fps = 0.0f;
+    // Drawing logic
+    glm::mat4 proj;
 
-    // Main loop
-    while (!window.shouldClose()) {
+    const auto draw_splat = [&](const SplatShape& splat, bool draw_to_window = true) {
+        const std::span<const glm::vec2> vertices(snapshot->points.data() + splat.first, splat.count);
+        if (draw_to_window && debug) {
+            // Debug vertices
+            glColor4f(splat.color.r, splat.color.g, splat.color.b, splat.color.a);
+            glBegin(GL_TRIANGLE_FAN);
 
-        // Calculate time delta
-        const auto new_t = std::chrono::system_clock::now();
+            for (int i = 0; i <= vertices.size(); i++) {
+                const int j = i % vertices.size();
+                const glm::vec2 point = canvas.window_coords(vertices[j]);
+                const glm::vec4 point_proj = proj * glm::vec4(point, 0.0f, 1.0f);
+                glVertex2f(point_proj.x, point_proj.y);
+            }
 
-        // Time step
-        if (tps > 0) {
+            glEnd();
 
-            const float dt = std::chrono::duration<float>(new_t - t).count();
-            time_accum += dt;
+        } else {
+            // Two pass stencil buffer approach
+            glEnable(GL_STENCIL_TEST);
+            float x_min = draw_to_window ? win_size.x : canvas.size.x, x_max = 0, y_min = draw_to_window ? win_size.y : canvas.size.y, y_max = 0; // Bounding box
 
-            const float time_step = 1.0f / tps;
-            while (time_accum >= time_step) {
-                time_accum -= time_step;
-                fps = 1.0f / dt;
+            // First pass: mask out color buffer, draw splat to stencil buffer
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glStencilOp(GL_INVERT, GL_INVERT, GL_INVERT);
 
-                glBindFramebuffer(GL_FRAMEBUFFER, wet_map_fbo);
-                glViewport(0, 0, canvas.size.x, canvas.size.y);
+            glBegin(GL_TRIANGLE_FAN);
 
-                glReadPixels(0, 0, canvas.size.x, canvas.size.y, GL_RGBA, GL_FLOAT, wet_map_data);
-                for (auto it = live_splats.begin(); it != live_splats.end(); it++) {
-                    if (it->life >= 0) {
-                        // Advect flowing splats
-                        if ((it->advect(canvas, wet_map_data, gravity) || resample_counter == resample_period) && resample_period > 0)
-                            it->resample(); // Resample boundary periodically or when a splat becomes fixed
-                    } else if (it->life >= -drying_time)
-                        // Age fixed splats
-                        it->age(canvas, wet_map_data, lifetime, unfixing_strength);
-                }
+            for (int i = 0; i <= vertices.size(); i++) {
+                const int j = i % vertices.size();
+                const glm::vec2 point = draw_to_window ? canvas.window_coords(vertices[j]) : vertices[j];
+                const glm::vec4 point_proj = proj * glm::vec4(point, 0.0f, 1.0f);
+                glVertex2f(point_proj.x, point_proj.y);
+
+                // Update bounding box
+                x_min = std::min(point_proj.x, x_min);
+                x_max = std::max(point_proj.x, x_max);
+                y_min = std::min(point_proj.y, y_min);
+                y_max = std::max(point_proj.y, y_max);
+            }
 
-                if (resample_period > 0)
-                    resample_counter = resample_counter % resample_period + 1;
+            glEnd();
 
-                // Reduce wetness
-                glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
-                glBlendFunc(GL_ONE, GL_ONE);
+            // Second pass: draw quad to color buffer, clear stencil buffer
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glColor4f(splat.color.r, splat.color.g, splat.color.b, splat.color.a);
+            glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+
+            // Draw quad around bounding box
+            glBegin(GL_QUADS);
+            glVertex2f(x_min, y_min);
+            glVertex2f(x_max, y_min);
+            glVertex2f(x_max, y_max);
+            glVertex2f(x_min, y_max);
+            glEnd();
 
-                glColor4f(0.0f, 0.0f, 0.0f, 0.005f);
-                glBegin(GL_QUADS);
-                glVertex2f(-1.0f, -1.0f);
-                glVertex2f(1.0f, -1.0f);
-                glVertex2f(1.0f, 1.0f);
-                glVertex2f(-1.0f, 1.0f);
-                glEnd();
+            glDisable(GL_STENCIL_TEST);
+        }
+    };
 
-                glBlendEquation(GL_FUNC_ADD);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // What the simulation was last told
+    Settings sent_settings = settings;
+    int sent_tps = tps;
+    bool sent_degrade = degrade;
+
+    // Main loop
+    while (!window.shouldClose()) {
+
+        const auto now = std::chrono::steady_clock::now();
+        frame_time += 0.05f * (std::chrono::duration<float>(now - frame_start).count() - frame_time);
+        frame_time_history.add(std::chrono::duration<float, std::milli>(now - frame_start).count());
+        frame_start = now;
+
+        // Pass changed settings on to the simulation
+        const bool export_wet_map = show_wetness || (debug && debug_mode == DebugMode::Wetness);
+        simulation.export_wet_map.store(export_wet_map, std::memory_order_relaxed);
+        if (settings != sent_settings || tps != sent_tps || degrade != sent_degrade) {
+            if (settings != sent_settings)
+                simulation.perform(action::SetSettings { settings });
+            simulation.send([tps, degrade](Simulation& simulation) {
+                simulation.tps = tps;
+                simulation.scheduler.degrade = degrade;
+            });
+            sent_settings = settings;
+            sent_tps = tps;
+            sent_degrade = degrade;
+        }
+
+        // Take the latest snapshot, drawing the splats which dried since the last one onto the canvas texture and uploading the changes to the wet map
+        if (const Snapshot* latest = simulation.snapshots.take(); latest && latest->generation == generation) {
+            snapshot = latest;
+            trace.append(snapshot->trace_events);
+            if (!snapshot->dried.empty()) {
+                const ScopedTimer timer(frame_history[CompositeDried], trace, frame_phase_names[CompositeDried]);
+                glBindFramebuffer(GL_FRAMEBUFFER, bg_fbo);
+                glViewport(0, 0, canvas.size.x, canvas.size.y);
+                proj = canvas.proj;
+                for (const SplatShape& splat : snapshot->dried)
+                    draw_splat(splat, false);
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
             }
+
+            const ScopedTimer timer(frame_history[UploadWetMap], trace, frame_phase_names[UploadWetMap]);
+            glBindTexture(GL_TEXTURE_2D, wet_map);
+            for (const Snapshot::WetPatch& patch : snapshot->wet_patches)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, patch.min.x, patch.min.y, patch.size.x, patch.size.y, GL_RGBA, GL_UNSIGNED_BYTE, snapshot->wet_pixels.data() + patch.offset);
         }
 
-        t = new_t;
         window.updateInput();
 
         // GUI
         {
+            const ScopedTimer timer(frame_history[Gui], trace, frame_phase_names[Gui]);
+
             // Main menu
             ImGui::BeginMainMenuBar();
             if (ImGui::BeginMenu("File")) {
@@ -463,6 +565,8 @@ int main()
                     open_canvas();
                 if (ImGui::MenuItem("Save", "Ctrl+S", nullptr))
                     show_save_canvas_window = true;
+                if (ImGui::MenuItem("Save journal", nullptr, nullptr))
+                    save_journal();
                 ImGui::EndMenu();
             }
             if (ImGui::BeginMenu("Edit")) {
@@ -471,15 +575,14 @@ int main()
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip(tps > 0 ? "Pause the simulation." : "Unpause the simulation.");
                 if (ImGui::MenuItem("Force resample", "S", nullptr))
-                    for (auto& splat : live_splats)
-                        splat.resample();
+                    simulation.perform(action::Resample {});
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Force the splat boundary resampling step.");
                 ImGui::Separator();
-                if (ImGui::MenuItem("Undo", "Ctrl+Z", nullptr, live_splats.size() > 0))
-                    undo();
-                if (ImGui::MenuItem("Redo", "Ctrl+Y", nullptr, undone_splats.size() > 0))
-                    redo();
+                if (ImGui::MenuItem("Undo", "Ctrl+Z", nullptr, snapshot && snapshot->live_splats > 0))
+                    simulation.perform(action::Undo {});
+                if (ImGui::MenuItem("Redo", "Ctrl+Y", nullptr, snapshot && snapshot->undone_splats > 0))
+                    simulation.perform(action::Redo {});
                 ImGui::EndMenu();
             }
             if (ImGui::BeginMenu("View")) {
@@ -517,7 +620,8 @@ int main()
                 // Brush settings
                 ImGui::Text("Brush");
                 ImGui::Combo("##", &stamp_idx, stamp_names_separated_by_zeros);
-                stamps[stamp_idx]->menu();
+                if (stamp_menu(stamps[stamp_idx]))
+                    simulation.perform(action::SetStamp { (uint8_t)stamp_idx, stamps[stamp_idx] });
 
                 ImGui::Separator();
                 ImGui::SliderInt("Radius", &brush_size, 1, 50);
@@ -531,7 +635,7 @@ int main()
                 ImGui::SliderInt("Spacing", &stamp_spacing, 1, 10);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Spacing between stamps in a stroke.");
-                ImGui::SliderInt("Lifetime", &lifetime, 0, 300);
+                ImGui::SliderInt("Lifetime", &settings.lifetime, 0, 300);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Flowing time in ticks.");
                 ImGui::Separator();
@@ -543,30 +647,130 @@ int main()
                 ImGui::SliderInt("TPS", &tps, 0, 120);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Simulation speed in ticks-per-second.");
-                ImGui::SliderFloat("Gravity", &gravity, 0.0f, 1.0f);
+                ImGui::SliderFloat("Gravity", &settings.gravity, 0.0f, 1.0f);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Strength of the global gravity vector.");
-                ImGui::SliderInt("Drying time", &drying_time, 0, 3600);
+                ImGui::SliderInt("Drying time", &settings.drying_time, 0, 3600);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Drying time in ticks.\nSplats which have been fixed for this long will be dried.");
-                ImGui::SliderInt("Resample pd", &resample_period, 0, 60);
+                ImGui::SliderInt("Resample pd", &settings.resample_period, 0, 60);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Period between splat boundary resampling steps in ticks.\nSet to 0 to disable.");
-                SliderPercent("Unfixing", &unfixing_strength, 0.0f, 1.0f);
+                SliderPercent("Unfixing", &settings.unfixing_strength, 0.0f, 1.0f);
                 if (ImGui::IsItemHovered())
                     ImGui::SetTooltip("Strength of the unfixing property of water:\nProbability that a vertex becomes unfixed when rewetted.");
+                ImGui::SliderInt("Threads", &settings.threads, 0, WatercolourEngine::max_threads());
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Number of threads used by the simulation.\nSet to 0 to use all cores.");
+                ImGui::Combo("Sleep", (int*)&settings.sleep_mode, "Off\0Dry\0Stalled");
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("When flowing splats stop being advected until water is added near them:\nDry: none of their vertices can reach wet paper.\nStalled: also when none of their vertices have moved for a while.");
+                if (settings.sleep_mode == SleepMode::Stalled) {
+                    ImGui::SliderInt("Sleep after", &settings.sleep_ticks, 1, 120);
+                    if (ImGui::IsItemHovered())
+                        ImGui::SetTooltip("Ticks without any vertex moving before a splat is put to sleep.");
+                }
+                ImGui::Checkbox("Degrade under load", &degrade);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("When ticking takes too long to keep up with the TPS, resample less often,\nthen not at all, then halve the TPS, to keep the interface responsive.");
+                ImGui::Checkbox("Cold storage", &settings.cold_storage);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Keep only the quantised positions of the vertices of fixed splats\nuntil they are rewetted, which takes a quarter of the memory.");
+                ImGui::Checkbox("Adaptive vertices", &settings.adaptive_vertices);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Resample splats into a number of vertices chosen from their perimeter and curvature,\ninstead of keeping the number they were placed with.");
+                if (settings.adaptive_vertices) {
+                    ImGui::DragIntRange2("Vertex range", &settings.min_vertices, &settings.max_vertices, 1.0f, 6, 128);
+                    ImGui::SliderFloat("Vertex spacing", &settings.vertex_spacing, 1.0f, 16.0f);
+                    if (ImGui::IsItemHovered())
+                        ImGui::SetTooltip("Distance in pixels between vertices along a smooth boundary.\nSplats with rougher boundaries get more vertices.");
+                    ImGui::SliderInt("Vertex budget", &settings.vertex_budget, 0, 1000000);
+                    if (ImGui::IsItemHovered())
+                        ImGui::SetTooltip("Total number of vertices to keep all splats within, by giving splats fewer vertices.\nSet to 0 for no limit.");
+                }
 
                 // Debug info
                 if (debug) {
                     ImGui::Separator();
-                    ImGui::Text("Debug (%d fps)", (int)fps);
+                    ImGui::Text("Debug (%d fps)", frame_time > 0.0f ? (int)(1.0f / frame_time) : 0);
                     ImGui::RadioButton("Fill", (int*)&debug_mode, (int)DebugMode::Fill);
                     ImGui::SameLine();
                     ImGui::RadioButton("Points", (int*)&debug_mode, (int)DebugMode::Points);
                     ImGui::SameLine();
                     ImGui::RadioButton("Wet map", (int*)&debug_mode, (int)DebugMode::Wetness);
-                    ImGui::Text("Strokes: %d", stroke_id);
-                    ImGui::Text("Live splats: %d", live_splats.size());
+                    if (snapshot) {
+                        ImGui::Text("Strokes: %d", snapshot->stroke_id);
+                        ImGui::Text("Live splats: %d", (int)snapshot->live_splats);
+                        ImGui::Text("Sleeping splats: %d", (int)snapshot->sleeping_splats);
+                        ImGui::Text("Vertices: %d", (int)snapshot->vertices);
+                        ImGui::Text("Frozen vertices: %d", (int)snapshot->frozen_vertices);
+                        ImGui::Text("Wet map: %d B/px", snapshot->wet_map_bytes_per_pixel);
+                        ImGui::Text("Tick: %.2f ms (%d%% load)", snapshot->tick_time * 1000.0f, (int)(snapshot->load * 100.0f));
+                        ImGui::Text("Late ticks: %d, dropped: %d", (int)snapshot->late_ticks, (int)snapshot->dropped_ticks);
+                        ImGui::Text("Degradation: %s", TickScheduler::name(snapshot->level));
+
+
+                        // Average time of each phase of a tick, when it started after the tick did and its recent times, the critical path marked
+                        if (ImGui::BeginTable("Tick phases", 4, ImGuiTableFlags_SizingFixedFit)) {
+                            ImGui::TableSetupColumn("Tick phase");
+                            ImGui::TableSetupColumn("ms");
+                            ImGui::TableSetupColumn("Start");
+                            ImGui::TableSetupColumn("Recent");
+                            ImGui::TableHeadersRow();
+                            for (int p = 0; p < tick_phase_count; p++) {
+                                const PhaseTime& time = snapshot->phase_times[p];
+                                ImGui::TableNextRow();
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%s%s", WatercolourEngine::name((TickPhase)p), snapshot->critical_path >> p & 1 ? " *" : "");
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.3f", time.average * 1000.0f);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.3f", time.start * 1000.0f);
+                                ImGui::TableNextColumn();
+                                plot_history(WatercolourEngine::name((TickPhase)p), snapshot->phase_history[p], 20.0f);
+                            }
+                            ImGui::EndTable();
+                        }
+
+                        const TickCounters& counters = snapshot->counters;
+                        ImGui::Text("Advected vertices: %d", (int)counters.advected_vertices);
+                        plot_history("Advected vertices", snapshot->advected_history, 30.0f);
+                        ImGui::Text("Rejected moves: %d", (int)counters.rejected_moves);
+                        plot_history("Rejected moves", snapshot->rejected_history, 30.0f);
+                        ImGui::Text("Memory: %.1f MB (splat pool resized in %d ticks)", counters.bytes / 1048576.0f, (int)counters.pool_resizes);
+                    }
+
+                    // The render thread's share of a frame, which does not include the time the GPU takes to draw it
+                    if (ImGui::BeginTable("Frame phases", 2, ImGuiTableFlags_SizingFixedFit)) {
+                        ImGui::TableSetupColumn("Frame phase");
+                        ImGui::TableSetupColumn("Recent");
+                        ImGui::TableHeadersRow();
+                        for (size_t p = 0; p < frame_phase_names.size(); p++) {
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%s", frame_phase_names[p]);
+                            ImGui::TableNextColumn();
+                            plot_history(frame_phase_names[p], frame_history[p], 20.0f);
+                        }
+                        ImGui::EndTable();
+                    }
+                    ImGui::Text("Frame time");
+                    plot_history("Frame time", frame_time_history, 30.0f);
+
+                    // Record a trace of both threads to export for chrome://tracing, Perfetto or a spreadsheet
+                    if (ImGui::Checkbox("Record trace", &tracing)) {
+                        trace.recording = tracing;
+                        if (tracing)
+                            trace.events.clear();
+                        simulation.send([tracing](Simulation& simulation) {
+                            simulation.engine.trace.recording = tracing;
+                            simulation.engine.trace.events.clear();
+                        });
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Export trace"))
+                        export_trace();
+                    ImGui::Text("Trace events: %d", (int)trace.events.size());
                     ImGui::Text("Last stamp: (%f, %f)", last_stamp.x, last_stamp.y);
                 }
             }
@@ -581,16 +785,20 @@ int main()
                     static int width = canvas.size.x;
                     static int height = canvas.size.y;
                     static glm::vec3 bg_color = { 0.9f, 0.9f, 0.9f };
+                    static WetMapFormat format = snapshot ? snapshot->wet_map_format : WetMapFormat::Float;
 
                     ImGui::InputInt("Width", &width);
                     ImGui::InputInt("Height", &height);
                     ImGui::ColorEdit3("", &bg_color.r);
+                    ImGui::Combo("Wet map", (int*)&format, "Float\0Compact 8-bit\0Compact 16-bit");
+                    if (ImGui::IsItemHovered())
+                        ImGui::SetTooltip("Storage format of the wet map.\nThe compact formats quantise the velocity and wetness of the water,\nusing 3 or 4 bytes per pixel instead of 12.");
 
                     width = std::clamp(width, 1, 4000);
                     height = std::clamp(height, 1, 4000);
 
                     if (ImGui::Button("OK")) {
-                        new_canvas(glm::ivec2(width, height), bg_color);
+                        new_canvas(glm::ivec2(width, height), bg_color, format);
                         show_new_canvas_window = false;
                     }
 
@@ -603,7 +811,7 @@ int main()
 
             // Save canvas window
             if (show_save_canvas_window) {
-                if (live_splats.size() == 0) {
+                if (snapshot && snapshot->live_splats == 0) {
                     show_save_canvas_window = false;
                     save_canvas();
                 } else {
@@ -612,7 +820,7 @@ int main()
                     ImGui::Begin("Save canvas", &show_save_canvas_window, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse);
                     {
                         ImGui::Text("Waiting for paint to dry...");
-                        ImGui::Text("Remaining splats: %d", live_splats.size());
+                        ImGui::Text("Remaining splats: %d", snapshot ? (int)snapshot->live_splats : 0);
 
                         if (ImGui::Button("Cancel"))
                             show_save_canvas_window = false;
@@ -622,85 +830,13 @@ int main()
             }
         }
 
-        // Drawing logic
-        glm::mat4 proj;
-
-        const auto draw_splat = [&](const Splat& splat, bool draw_to_window = true) {
-            if (draw_to_window && debug) {
-                // Debug vertices
-                glColor4f(splat.color.r, splat.color.g, splat.color.b, splat.color.a);
-                glBegin(GL_TRIANGLE_FAN);
-
-                for (int i = 0; i <= splat.vertices.size(); i++) {
-                    const int j = i % splat.vertices.size();
-                    const glm::vec2 point = canvas.window_coords(splat.vertices[j].pos);
-                    const glm::vec4 point_proj = proj * glm::vec4(point, 0.0f, 1.0f);
-                    glVertex2f(point_proj.x, point_proj.y);
-                }
-
-                glEnd();
-
-            } else {
-                // Two pass stencil buffer approach
-                glEnable(GL_STENCIL_TEST);
-                float x_min = draw_to_window ? win_size.x : canvas.size.x, x_max = 0, y_min = draw_to_window ? win_size.y : canvas.size.y, y_max = 0; // Bounding box
-
-                // First pass: mask out color buffer, draw splat to stencil buffer
-                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-                glStencilOp(GL_INVERT, GL_INVERT, GL_INVERT);
-
-                glBegin(GL_TRIANGLE_FAN);
-
-                for (int i = 0; i <= splat.vertices.size(); i++) {
-                    const int j = i % splat.vertices.size();
-                    const glm::vec2 point = draw_to_window ? canvas.window_coords(splat.vertices[j].pos) : splat.vertices[j].pos;
-                    const glm::vec4 point_proj = proj * glm::vec4(point, 0.0f, 1.0f);
-                    glVertex2f(point_proj.x, point_proj.y);
-
-                    // Update bounding box
-                    x_min = std::min(point_proj.x, x_min);
-                    x_max = std::max(point_proj.x, x_max);
-                    y_min = std::min(point_proj.y, y_min);
-                    y_max = std::max(point_proj.y, y_max);
-                }
-
-                glEnd();
-
-                // Second pass: draw quad to color buffer, clear stencil buffer
-                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-                glColor4f(splat.color.r, splat.color.g, splat.color.b, splat.color.a);
-                glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
-
-                // Draw quad around bounding box
-                glBegin(GL_QUADS);
-                glVertex2f(x_min, y_min);
-                glVertex2f(x_max, y_min);
-                glVertex2f(x_max, y_max);
-                glVertex2f(x_min, y_max);
-                glEnd();
-
-                glDisable(GL_STENCIL_TEST);
-            }
-        };
-
-        // Draw dried splats to the canvas texture
-        while (live_splats.size() > 0 && live_splats.front().life < -drying_time) {
-            glBindFramebuffer(GL_FRAMEBUFFER, bg_fbo);
-            glViewport(0, 0, canvas.size.x, canvas.size.y);
-            proj = canvas.proj;
-            while (live_splats.size() > 0 && live_splats.front().life < -drying_time) {
-                draw_splat(live_splats.front(), false);
-                live_splats.pop_front();
-            }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        }
-
         // Draw canvas
         glViewport(0, 0, win_size.x, win_size.y);
         glClear(GL_COLOR_BUFFER_BIT);
         proj = glm::ortho(0.0f, (float)win_size.x, 0.0f, (float)win_size.y, -1.0f, 1.0f);
 
         canvas.draw_backdrop(proj);
+
         if (!debug || debug_mode != DebugMode::Wetness) {
             // Draw the canvas texture
             canvas.draw_texture(proj, bg);
@@ -708,7 +844,11 @@ int main()
             // Draw "live" splats to the canvas
             if (debug && debug_mode == DebugMode::Points)
                 glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
-            std::for_each(live_splats.begin(), live_splats.end(), draw_splat);
+            if (snapshot) {
+                const ScopedTimer timer(frame_history[DrawSplats], trace, frame_phase_names[DrawSplats]);
+                for (const SplatShape& splat : snapshot->live)
+                    draw_splat(splat);
+            }
             glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
             // Darkening effect of the wet map
@@ -729,12 +869,11 @@ int main()
             // Draw a circle
             glColor4f(0.0f, 0.0f, 0.0f, stroke ? 0.8f : 0.6f);
             glBegin(GL_LINE_LOOP);
-            for (int i = 0; i < vertices; i++) {
-                const float angle = i * 2.0f * glm::pi<float>() / vertices;
-                const glm::vec2 point = canvas.clamp_point(glm::vec2(cos(angle) * canvas.zoom * brush_size, sin(angle) * canvas.zoom * brush_size) + cursor_pos);
+            unit_circle::for_each(vertices, [&](int, const glm::vec2& dir) {
+                const glm::vec2 point = canvas.clamp_point(dir * canvas.zoom * (float)brush_size + cursor_pos);
                 const glm::vec4 point_proj = proj * glm::vec4(point, 0.0f, 1.0f);
                 glVertex2f(point_proj.x, point_proj.y);
-            }
+            });
             glEnd();
 
         } else
@@ -0,0 +1,40 @@
+// Brush-specific settings for each stamp, return true iff any was changed
+bool stamp_menu(Crunchy& crunchy)
+{
+    const bool changed = ImGui::SliderFloat("Scale", &crunchy.scale, 0.25f, 1.0f);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("The size of the splat relative to the wetting region.\nLower this below 1.0, reduce flow and increase roughness to achieve\nthe effect of the \"crunchy\" brush described in the paper.");
+    return changed;
+}
+
+bool stamp_menu(WetOnDry& wet_on_dry)
+{
+    bool changed = ImGui::SliderInt("Lobes", &wet_on_dry.lobes, 2, 12);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("The number of extra splats to be placed around the centre.\nThis is fixed at 6 in the brush described by the paper.");
+    changed |= ImGui::SliderFloat("Bias", &wet_on_dry.b, 0.0f, 0.2f);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("The outer splats have an outward motion bias.\nAdjust this factor to the brush size and lifetime.");
+    return changed;
+}
+
+bool stamp_menu(WetOnWet& wet_on_wet)
+{
+    const bool changed = ImGui::SliderFloat("Scale", &wet_on_wet.scale, 0.5f, 2.0f);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("The relative size of the outer of the two splats.\nEffectively fixed at 1.5 in the brush described by the paper.");
+    return changed;
+}
+
+bool stamp_menu(Blobby& blobby)
+{
+    const bool changed = ImGui::SliderFloat("Offset", &blobby.offset, 0.0f, 1.5f);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("The offset of the splats from the centre of the stroke.");
+    return changed;
+}
+
+bool stamp_menu(BuiltinStamp& stamp)
+{
+    return std::visit([](auto& s) { return stamp_menu(s); }, stamp);
+}